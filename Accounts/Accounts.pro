@@ -10,17 +10,24 @@ public_headers = \
     accountscommon.h \
     Manager manager.h \
     Account account.h \
+    AccountData account-data.h \
     AccountService account-service.h \
     Application application.h \
+    AsyncManager async-manager.h \
     AuthData auth-data.h \
     Error error.h \
     Provider provider.h \
+    RetryPolicy retry-policy.h \
     Service service.h \
+    SettingKey setting-key.h \
+    Statistics statistics.h \
     ServiceType service-type.h
 
 private_headers = \
+    key-tree.h \
     manager_p.h \
-    utils.h
+    utils.h \
+    watch-dispatcher.h
 
 HEADERS += \
     $$public_headers \
@@ -28,14 +35,19 @@ HEADERS += \
 
 SOURCES += manager.cpp \
     account.cpp \
+    account-data.cpp \
     account-service.cpp \
     application.cpp \
+    async-manager.cpp \
     auth-data.cpp \
     error.cpp \
+    key-tree.cpp \
     provider.cpp \
     service.cpp \
     service-type.cpp \
-    utils.cpp
+    statistics.cpp \
+    utils.cpp \
+    watch-dispatcher.cpp
 
 CONFIG += link_pkgconfig
 
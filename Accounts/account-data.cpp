@@ -0,0 +1,200 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "account-data.h"
+#include "utils.h"
+
+#include <QSharedData>
+#include <libaccounts-glib/ag-account.h>
+#include <libaccounts-glib/ag-service.h>
+
+namespace Accounts {
+
+/*!
+ * @class AccountData
+ * @headerfile account-data.h Accounts/AccountData
+ *
+ * @brief A read-only snapshot of an account.
+ *
+ * @details The AccountData class holds the main properties and the global
+ * settings of an account, as they were when the object was obtained from
+ * Manager::accountData(). Unlike Account, it is not a QObject, it doesn't
+ * emit any signals and it doesn't keep any connection to the account
+ * database: it is an implicitly shared value type meant for jobs which need
+ * to read many accounts at once, and which would otherwise pay the cost of
+ * an Account object for each of them.
+ *
+ * @see Manager::accountData()
+ */
+
+class AccountData::Private: public QSharedData
+{
+public:
+    Private(): id(0), enabled(false) {}
+
+    AccountId id;
+    QString providerName;
+    QString displayName;
+    bool enabled;
+    QStringList enabledServices;
+    QVariantMap values;
+};
+
+}; // namespace
+
+using namespace Accounts;
+
+/*!
+ * Constructs an invalid object.
+ */
+AccountData::AccountData():
+    d(new Private)
+{
+}
+
+AccountData::AccountData(AgAccount *account):
+    d(new Private)
+{
+    d->id = account->id;
+    d->providerName = UTF8(ag_account_get_provider_name(account));
+    d->displayName = UTF8(ag_account_get_display_name(account));
+
+    /* The account object might be shared with an Account instance: read the
+     * global settings without altering its selected service */
+    AgService *selected = ag_account_get_selected_service(account);
+    if (selected != 0) ag_account_select_service(account, NULL);
+
+    d->enabled = ag_account_get_enabled(account);
+
+    AgAccountSettingIter iter;
+    const gchar *key;
+    GVariant *value;
+    ag_account_settings_iter_init(account, &iter, NULL);
+    while (ag_account_settings_iter_get_next(&iter, &key, &value)) {
+        d->values.insert(ASCII(key), gVariantToQVariant(value));
+    }
+
+    if (selected != 0) ag_account_select_service(account, selected);
+
+    GList *list = ag_account_list_enabled_services(account);
+    for (GList *l = list; l != NULL; l = l->next) {
+        AgService *service = (AgService*)l->data;
+        d->enabledServices.append(UTF8(ag_service_get_name(service)));
+    }
+    ag_service_list_free(list);
+}
+
+/*!
+ * Copy constructor. Copying an AccountData object is very cheap, because the
+ * data is shared among copies.
+ */
+AccountData::AccountData(const AccountData &other):
+    d(other.d)
+{
+}
+
+/*!
+ * Assignment operator.
+ */
+AccountData &AccountData::operator=(const AccountData &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+ * Destructor.
+ */
+AccountData::~AccountData()
+{
+}
+
+/*!
+ * @return Whether the object holds the data of an account.
+ */
+bool AccountData::isValid() const
+{
+    return d->id != 0;
+}
+
+/*!
+ * @return The ID of the account.
+ */
+AccountId AccountData::id() const
+{
+    return d->id;
+}
+
+/*!
+ * @return The name of the provider of the account.
+ */
+QString AccountData::providerName() const
+{
+    return d->providerName;
+}
+
+/*!
+ * @return The display name of the account.
+ */
+QString AccountData::displayName() const
+{
+    return d->displayName;
+}
+
+/*!
+ * @return Whether the account is enabled.
+ */
+bool AccountData::isEnabled() const
+{
+    return d->enabled;
+}
+
+/*!
+ * @return The names of the enabled services of the account. If the manager
+ * was constructed with a service type, only the services of that type are
+ * listed.
+ */
+QStringList AccountData::enabledServices() const
+{
+    return d->enabledServices;
+}
+
+/*!
+ * @return All the global settings of the account, including the default
+ * values defined by the provider.
+ */
+QVariantMap AccountData::values() const
+{
+    return d->values;
+}
+
+/*!
+ * Gets the value of a global setting of the account.
+ * @param key The full name of the key.
+ * @param defaultValue The value returned if the key is not set.
+ */
+QVariant AccountData::value(const QString &key,
+                            const QVariant &defaultValue) const
+{
+    return d->values.value(key, defaultValue);
+}
@@ -0,0 +1,77 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTS_ACCOUNT_DATA_H
+#define ACCOUNTS_ACCOUNT_DATA_H
+
+#include <QSharedDataPointer>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "Accounts/accountscommon.h"
+#include "Accounts/account.h"
+
+extern "C"
+{
+    typedef struct _AgAccount AgAccount;
+}
+
+namespace Accounts
+{
+
+class ACCOUNTS_EXPORT AccountData
+{
+public:
+    AccountData();
+    AccountData(const AccountData &other);
+    AccountData &operator=(const AccountData &other);
+    ~AccountData();
+
+    bool isValid() const;
+
+    AccountId id() const;
+    QString providerName() const;
+    QString displayName() const;
+    bool isEnabled() const;
+    QStringList enabledServices() const;
+
+    QVariantMap values() const;
+    QVariant value(const QString &key,
+                   const QVariant &defaultValue = QVariant()) const;
+
+private:
+    // Don't include private data in docs: \cond
+    class Private;
+    friend class Manager;
+    explicit AccountData(AgAccount *account);
+
+    QSharedDataPointer<Private> d;
+    // \endcond
+};
+
+typedef QList<AccountData> AccountDataList;
+
+} //namespace Accounts
+
+#endif // ACCOUNTS_ACCOUNT_DATA_H
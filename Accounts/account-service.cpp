@@ -23,12 +23,15 @@
  */
 
 #include "account-service.h"
+#include "key-tree.h"
 #include "manager.h"
+#include "manager_p.h"
 #include "utils.h"
 #include <QPointer>
 #include <libaccounts-glib/ag-account.h>
 #include <libaccounts-glib/ag-account-service.h>
 #include <libaccounts-glib/ag-auth-data.h>
+#include <libaccounts-glib/ag-service.h>
 
 namespace Accounts
 {
@@ -118,10 +121,23 @@ private:
     static void onEnabled(AccountService *accountService, gboolean isEnabled);
     static void onChanged(AccountService *accountService);
 
+    const KeyTree &keyTree() const;
+    void recordChange(const char *key);
+    Manager *manager() const {
+        return m_account.isNull() ? 0 : m_account->manager();
+    }
+
+    void setPrefix(const QString &newPrefix) {
+        prefix = newPrefix;
+        prefixLatin1 = newPrefix.toLatin1();
+    }
+
     ServiceList m_serviceList;
     AgAccountService *m_accountService;
     QPointer<Account> m_account;
     QString prefix;
+    QByteArray prefixLatin1;
+    mutable KeyTree m_keyTree;
     mutable AccountService *q_ptr;
 };
 
@@ -156,14 +172,43 @@ AccountServicePrivate::~AccountServicePrivate()
     m_accountService = 0;
 }
 
+const KeyTree &AccountServicePrivate::keyTree() const
+{
+    AgAccount *account = ag_account_service_get_account(m_accountService);
+    if (!m_keyTree.isValid(account)) {
+        AgAccountSettingIter iter;
+        ag_account_service_settings_iter_init(m_accountService, &iter, "");
+        m_keyTree.build(account, &iter);
+    }
+    return m_keyTree;
+}
+
+/* Records the change of a setting in the account; see
+ * Account::pendingChanges() */
+void AccountServicePrivate::recordChange(const char *key)
+{
+    if (m_account.isNull()) return;
+
+    m_account->recordChange(ag_account_service_get_service(m_accountService),
+                            key);
+}
+
 void AccountServicePrivate::onEnabled(AccountService *accountService,
                                       gboolean isEnabled)
 {
+    Manager::Private::Measurement measurement(
+        accountService->d_ptr->manager(), Statistics::SignalDelivery);
+    KeyTree::touch(ag_account_service_get_account(
+        accountService->d_ptr->m_accountService));
     Q_EMIT accountService->enabled(isEnabled);
 }
 
 void AccountServicePrivate::onChanged(AccountService *accountService)
 {
+    Manager::Private::Measurement measurement(
+        accountService->d_ptr->manager(), Statistics::SignalDelivery);
+    KeyTree::touch(ag_account_service_get_account(
+        accountService->d_ptr->m_accountService));
     Q_EMIT accountService->changed();
 }
 
@@ -250,9 +295,8 @@ QStringList AccountService::allKeys() const
     GVariant *val;
 
     /* iterate the settings */
-    QByteArray tmp = d->prefix.toLatin1();
     ag_account_service_settings_iter_init(d->m_accountService,
-                                          &iter, tmp.constData());
+                                          &iter, d->prefixLatin1.constData());
     while (ag_account_settings_iter_get_next(&iter, &key, &val))
     {
         allKeys.append(ASCII(key));
@@ -267,7 +311,7 @@ QStringList AccountService::allKeys() const
 void AccountService::beginGroup(const QString &prefix)
 {
     Q_D(AccountService);
-    d->prefix += prefix + slash;
+    d->setPrefix(d->prefix + prefix + slash);
 }
 
 /*!
@@ -275,18 +319,8 @@ void AccountService::beginGroup(const QString &prefix)
  */
 QStringList AccountService::childGroups() const
 {
-    QStringList groups, all_keys;
-
-    all_keys = allKeys();
-    Q_FOREACH (const QString &key, all_keys)
-    {
-        if (key.contains(slash)) {
-            QString group = key.section(slash, 0, 0);
-            if (!groups.contains(group))
-                groups.append(group);
-        }
-    }
-    return groups;
+    Q_D(const AccountService);
+    return d->keyTree().childGroups(d->prefix);
 }
 
 /*!
@@ -294,15 +328,8 @@ QStringList AccountService::childGroups() const
  */
 QStringList AccountService::childKeys() const
 {
-    QStringList keys, all_keys;
-
-    all_keys = allKeys();
-    Q_FOREACH (const QString &key, all_keys)
-    {
-        if (!key.contains(slash))
-            keys.append(key);
-    }
-    return keys;
+    Q_D(const AccountService);
+    return d->keyTree().childKeys(d->prefix);
 }
 
 /*!
@@ -315,9 +342,9 @@ void AccountService::clear()
     /* clear() must ignore the group: so, temporarily reset it and call
      * remove("") */
     QString saved_prefix = d->prefix;
-    d->prefix = QString();
+    d->setPrefix(QString());
     remove(QString());
-    d->prefix = saved_prefix;
+    d->setPrefix(saved_prefix);
 }
 
 /*!
@@ -326,7 +353,8 @@ void AccountService::clear()
  */
 bool AccountService::contains(const QString &key) const
 {
-    return childKeys().contains(key);
+    Q_D(const AccountService);
+    return d->keyTree().containsKey(d->prefix, key);
 }
 
 /*!
@@ -335,9 +363,10 @@ bool AccountService::contains(const QString &key) const
 void AccountService::endGroup()
 {
     Q_D(AccountService);
-    d->prefix = d->prefix.section(slash, 0, -3,
-                                  QString::SectionIncludeTrailingSep);
-    if (d->prefix[0] == slash) d->prefix.remove(0, 1);
+    QString prefix = d->prefix.section(slash, 0, -3,
+                                       QString::SectionIncludeTrailingSep);
+    if (prefix[0] == slash) prefix.remove(0, 1);
+    d->setPrefix(prefix);
 }
 
 /*!
@@ -358,7 +387,6 @@ QString AccountService::group() const
  */
 void AccountService::remove(const QString &key)
 {
-    Q_D(AccountService);
     if (key.isEmpty())
     {
         /* delete all keys in the group */
@@ -371,38 +399,70 @@ void AccountService::remove(const QString &key)
     }
     else
     {
-        QString full_key = d->prefix + key;
-        QByteArray tmpkey = full_key.toLatin1();
-        ag_account_service_set_variant(d->m_accountService,
-                                       tmpkey.constData(),
-                                       NULL);
+        remove(SettingKey(key));
     }
 }
 
+/*!
+ * Remove the given key.
+ * @param key The key name of the setting; if empty, all keys in the current
+ * group are removed.
+ */
+void AccountService::remove(const SettingKey &key)
+{
+    Q_D(AccountService);
+    if (key.isEmpty()) {
+        remove(QString());
+        return;
+    }
+
+    Manager::Private::Measurement measurement(d->manager(),
+                                              Statistics::WriteValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    d->recordChange(fullKey.constData());
+    ag_account_service_set_variant(d->m_accountService,
+                                   fullKey.constData(),
+                                   NULL);
+    KeyTree::touch(ag_account_service_get_account(d->m_accountService));
+}
+
 /*!
  * Change the value of an account setting.
  * @param key The name of the setting.
  * @param value The new value of the setting.
  */
 void AccountService::setValue(const QString &key, const QVariant &value)
+{
+    setValue(SettingKey(key), value);
+}
+
+void AccountService::setValue(const char *key, const QVariant &value)
+{
+    setValue(SettingKey(key), value);
+}
+
+/*!
+ * Change the value of an account setting.
+ * @param key The name of the setting.
+ * @param value The new value of the setting.
+ */
+void AccountService::setValue(const SettingKey &key, const QVariant &value)
 {
     Q_D(AccountService);
+    Manager::Private::Measurement measurement(d->manager(),
+                                              Statistics::WriteValue);
 
     GVariant *variant = qVariantToGVariant(value);
     if (variant == 0) {
         return;
     }
 
-    QString full_key = d->prefix + key;
-    QByteArray tmpkey = full_key.toLatin1();
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    d->recordChange(fullKey.constData());
     ag_account_service_set_variant(d->m_accountService,
-                                   tmpkey.constData(),
+                                   fullKey.constData(),
                                    variant);
-}
-
-void AccountService::setValue(const char *key, const QVariant &value)
-{
-    setValue(ASCII(key), value);
+    KeyTree::touch(ag_account_service_get_account(d->m_accountService));
 }
 
 /*!
@@ -419,14 +479,31 @@ void AccountService::setValue(const char *key, const QVariant &value)
 QVariant AccountService::value(const QString &key,
                                const QVariant &defaultValue,
                                SettingSource *source) const
+{
+    return value(SettingKey(key), defaultValue, source);
+}
+
+/*!
+ * Retrieves the value of an account setting, as a QVariant.
+ * @param key The key whose value must be retrieved.
+ * @param defaultValue Value returned if the key is unset.
+ * @param source Indicates whether the value comes from the account, the
+ * service template or was unset.
+ *
+ * @return The value associated to \a key.
+ */
+QVariant AccountService::value(const SettingKey &key,
+                               const QVariant &defaultValue,
+                               SettingSource *source) const
 {
     Q_D(const AccountService);
-    QString full_key = d->prefix + key;
-    QByteArray ba = full_key.toLatin1();
+    Manager::Private::Measurement measurement(d->manager(),
+                                              Statistics::ReadValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
     AgSettingSource settingSource;
     GVariant *variant =
         ag_account_service_get_variant(d->m_accountService,
-                                       ba.constData(),
+                                       fullKey.constData(),
                                        &settingSource);
     if (source != 0) {
         switch (settingSource) {
@@ -454,9 +531,120 @@ QVariant AccountService::value(const QString &key, SettingSource *source) const
 
 QVariant AccountService::value(const char *key, SettingSource *source) const
 {
-    return value(ASCII(key), source);
+    return value(SettingKey(key), QVariant(), source);
 }
 
+/*!
+ * Retrieves the value of an account setting.
+ * @param key The key whose value must be retrieved
+ * @param source Indicates whether the value comes from the account, the
+ * service template or was unset.
+ *
+ * Returns the value of the setting, or an invalid QVariant if unset.
+ */
+QVariant AccountService::value(const SettingKey &key,
+                               SettingSource *source) const
+{
+    return value(key, QVariant(), source);
+}
+
+/*!
+ * @fn T AccountService::value(const QString &key, const T &defaultValue, SettingSource *source) const
+ * Retrieves the value of an account setting, converted to the type \a T.
+ * @param key The key whose value must be retrieved.
+ * @param defaultValue Value returned if the key is unset, or if its value
+ * cannot be converted.
+ * @param source Indicates whether the value comes from the account, the
+ * service template or was unset.
+ *
+ * The value is read directly from the stored setting, without building a
+ * QVariant, unless a conversion between different types is needed. The
+ * supported types are the same as in Account::value<T>().
+ */
+template <typename T>
+T AccountService::value(const QString &key,
+                        const typename NonDeduced<T>::Type &defaultValue,
+                        SettingSource *source) const
+{
+    return value<T>(SettingKey(key), defaultValue, source);
+}
+
+/*!
+ * @fn T AccountService::value(const SettingKey &key, const T &defaultValue, SettingSource *source) const
+ * Retrieves the value of an account setting, converted to the type \a T.
+ * @see value(const QString &key, const T &defaultValue, SettingSource *source) const
+ */
+template <typename T>
+T AccountService::value(const SettingKey &key,
+                        const typename NonDeduced<T>::Type &defaultValue,
+                        SettingSource *source) const
+{
+    Q_D(const AccountService);
+    Manager::Private::Measurement measurement(d->manager(),
+                                              Statistics::ReadValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    AgSettingSource settingSource;
+    GVariant *variant =
+        ag_account_service_get_variant(d->m_accountService,
+                                       fullKey.constData(),
+                                       &settingSource);
+    if (source != 0) {
+        switch (settingSource) {
+        case AG_SETTING_SOURCE_ACCOUNT: *source = ACCOUNT; break;
+        case AG_SETTING_SOURCE_PROFILE: *source = TEMPLATE; break;
+        default: *source = NONE; break;
+        }
+    }
+
+    if (variant == 0) return defaultValue;
+
+    T result;
+    if (!gVariantToValue(variant, &result)) {
+        if (source != 0) *source = NONE;
+        return defaultValue;
+    }
+    return result;
+}
+
+// \cond
+template int AccountService::value<int>(const QString &, const int &,
+                                        SettingSource *) const;
+template uint AccountService::value<uint>(const QString &, const uint &,
+                                          SettingSource *) const;
+template qint64
+AccountService::value<qint64>(const QString &, const qint64 &,
+                              SettingSource *) const;
+template quint64
+AccountService::value<quint64>(const QString &, const quint64 &,
+                               SettingSource *) const;
+template bool AccountService::value<bool>(const QString &, const bool &,
+                                          SettingSource *) const;
+template QString
+AccountService::value<QString>(const QString &, const QString &,
+                               SettingSource *) const;
+template QStringList
+AccountService::value<QStringList>(const QString &, const QStringList &,
+                                   SettingSource *) const;
+template int AccountService::value<int>(const SettingKey &, const int &,
+                                        SettingSource *) const;
+template uint AccountService::value<uint>(const SettingKey &, const uint &,
+                                          SettingSource *) const;
+template qint64
+AccountService::value<qint64>(const SettingKey &, const qint64 &,
+                              SettingSource *) const;
+template quint64
+AccountService::value<quint64>(const SettingKey &, const quint64 &,
+                               SettingSource *) const;
+template bool AccountService::value<bool>(const SettingKey &, const bool &,
+                                          SettingSource *) const;
+template QString
+AccountService::value<QString>(const SettingKey &, const QString &,
+                               SettingSource *) const;
+template QStringList
+AccountService::value<QStringList>(const SettingKey &, const QStringList &,
+                                   SettingSource *) const;
+// \endcond
+
 /*!
  * This method should be called only in the context of a handler of the
  * AccountService::changed() signal, and can be used to retrieve the set of
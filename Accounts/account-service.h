@@ -68,15 +68,30 @@ public:
     QString group() const;
 
     void remove(const QString &key);
+    void remove(const SettingKey &key);
 
     void setValue(const char *key, const QVariant &value);
     void setValue(const QString &key, const QVariant &value);
+    void setValue(const SettingKey &key, const QVariant &value);
 
     QVariant value(const QString &key,
                    const QVariant &defaultValue,
                    SettingSource *source = 0) const;
     QVariant value(const QString &key, SettingSource *source = 0) const;
     QVariant value(const char *key, SettingSource *source = 0) const;
+    QVariant value(const SettingKey &key,
+                   const QVariant &defaultValue,
+                   SettingSource *source = 0) const;
+    QVariant value(const SettingKey &key, SettingSource *source = 0) const;
+
+    template <typename T>
+    T value(const QString &key,
+            const typename NonDeduced<T>::Type &defaultValue = T(),
+            SettingSource *source = 0) const;
+    template <typename T>
+    T value(const SettingKey &key,
+            const typename NonDeduced<T>::Type &defaultValue = T(),
+            SettingSource *source = 0) const;
 
     QStringList changedFields() const;
 
@@ -23,12 +23,26 @@
  */
 
 #include "account.h"
+#include "key-tree.h"
 #include "manager.h"
 #include "manager_p.h"
 #include "utils.h"
+#include "watch-dispatcher.h"
 
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMetaMethod>
 #include <QPointer>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
 #include <libaccounts-glib/ag-account.h>
+#include <libaccounts-glib/ag-account-service.h>
+#include <libaccounts-glib/ag-errors.h>
+#include <libaccounts-glib/ag-service.h>
+
+#include <random>
 
 namespace Accounts {
 
@@ -83,14 +97,71 @@ public:
         g_cancellable_cancel(m_cancellable);
         g_object_unref(m_cancellable);
         m_cancellable = NULL;
+        Q_FOREACH (AgAccountService *watcher, m_settingsWatchers) {
+            g_object_unref(watcher);
+        }
+        qDeleteAll(m_watchDispatchers);
     }
 
     void init(Account *account);
 
+    void setPrefix(const QString &newPrefix) {
+        prefix = newPrefix;
+        prefixLatin1 = newPrefix.toLatin1();
+    }
+
+    /* Names of the modified keys, indexed by the name of their service
+     * (empty for the global settings) */
+    typedef QHash<QByteArray,QSet<QByteArray> > Changes;
+
+    void store(Account *account);
+    void recordChange(AgService *service, const char *key);
+    static void mergeChanges(Changes &changes, const Changes &other);
+    void beginStore();
+    void endStore(bool succeeded);
+    Changes unstoredChanges() const;
+    bool scheduleStoreRetry(Account *account);
+    void record(Statistics::Operation operation, qint64 usecs);
+    KeyTree &keyTree();
+    AgAccountService *settingsWatcher(AgService *service,
+                                      const QString &serviceName);
+    quint32 addWatch(const SettingKey &key,
+                     const WatchDispatcher::Callback &callback);
+    void removeWatch(quint32 id);
+    bool checkServicesCache();
+    void invalidateServices() { m_servicesCacheValid = false; }
+
     QPointer<Manager> m_manager;
     AgAccount *m_account;  //real account
     GCancellable *m_cancellable;
     QString prefix;
+    QByteArray prefixLatin1;
+    QTimer *m_retryTimer;
+    int m_retryCount;
+    QElapsedTimer m_retryElapsed;
+    QElapsedTimer m_storeElapsed;
+    int m_storesInFlight; // including those waiting for a retry
+    bool m_syncQueued;
+    /* Cached results of services() (indexed by service type) and
+     * enabledServices() */
+    bool m_servicesCacheValid;
+    quint32 m_servicesCatalogGeneration;
+    QHash<QString,ServiceList> m_services;
+    ServiceList m_enabledServices;
+    bool m_enabledServicesValid;
+    /* Indexed by service name; empty for the global settings */
+    QHash<QString,KeyTree> m_keyTrees;
+    QHash<QString,AgAccountService*> m_settingsWatchers;
+    QHash<QString,WatchDispatcher*> m_watchDispatchers;
+    QHash<quint32,QString> m_watchServices; // service name of each watch
+    quint32 m_lastWatchId;
+    /* Changes made since the last store */
+    Changes m_pendingChanges;
+    bool m_deletionPending;
+    /* Changes handed to the store operations in progress, until they
+     * succeed */
+    Changes m_storingChanges;
+    bool m_deletionStoring;
 
     static void on_display_name_changed(Account *self);
     static void on_enabled(Account *self, const gchar *service_name,
@@ -99,13 +170,37 @@ public:
                                  GAsyncResult *res,
                                  Account *self);
     static void on_deleted(Account *self);
+    static void on_settings_changed(Private *d, AgAccountService *watcher);
+
+    Watch *createWatch(Account *account, const SettingKey &key,
+                       int batchInterval);
+    void queueChanges(Watch *watch, const QStringList &keys);
+    void deliverChanges(Watch *watch, const QStringList &keys);
 };
 
 class Watch::Private
 {
 public:
-    static void account_notify_cb(AgAccount *account, const gchar *key,
-                                  Watch *self);
+    Private(AgService *service, const QByteArray &key):
+        id(0),
+        key(key),
+        service(service ? ag_service_ref(service) : 0),
+        timer(0)
+    {
+    }
+    ~Private() { if (service != 0) ag_service_unref(service); }
+
+    static bool isChangedConnected(const Watch *watch) {
+        return watch->isSignalConnected(
+            QMetaMethod::fromSignal(&Watch::changed));
+    }
+
+    quint32 id;
+    QByteArray key;
+    AgService *service;
+    /* Only set if the notifications are batched */
+    QTimer *timer;
+    QStringList pendingKeys;
 };
 } //namespace Accounts
 
@@ -123,8 +218,19 @@ static QChar slash = QChar::fromLatin1('/');
  * common prefix, and not the actual key being changed.
  */
 
+/*!
+ * @fn Watch::changed(const QVariantMap &values)
+ *
+ * Emitted together with notify(), carrying the changes. The new values are
+ * only read when this signal is connected.
+ * @param values The full names of the keys which have changed, with their
+ * new values; the value of a key which has been removed is an invalid
+ * QVariant, unless the service defines a default for it.
+ */
+
 Watch::Watch(QObject *parent):
-    QObject(parent)
+    QObject(parent),
+    d(0)
 {
 }
 
@@ -134,15 +240,27 @@ Watch::~Watch()
     /* The destructor of Account deletes the child Watches before detaching
      * them, so here account should always be not NULL */
     Q_ASSERT(account != NULL);
-    ag_account_remove_watch(account->d->m_account, watch);
+    if (d != 0) account->d->removeWatch(d->id);
+    delete d;
+    d = 0;
 }
 
 Account::Private::Private(Manager *manager, const QString &providerName,
                           Account *account):
     m_manager(manager),
-    m_cancellable(g_cancellable_new())
+    m_cancellable(g_cancellable_new()),
+    m_retryTimer(0),
+    m_retryCount(0),
+    m_storesInFlight(0),
+    m_syncQueued(false),
+    m_servicesCacheValid(false),
+    m_servicesCatalogGeneration(0),
+    m_enabledServicesValid(false),
+    m_lastWatchId(0),
+    m_deletionPending(false),
+    m_deletionStoring(false)
 {
-    m_account = ag_manager_create_account(manager->d->m_manager,
+    m_account = ag_manager_create_account(manager->d->backend(),
                                           providerName.toUtf8().constData());
     init(account);
 }
@@ -150,7 +268,17 @@ Account::Private::Private(Manager *manager, const QString &providerName,
 Account::Private::Private(Manager *manager, AgAccount *agAccount):
     m_manager(manager),
     m_account(agAccount),
-    m_cancellable(g_cancellable_new())
+    m_cancellable(g_cancellable_new()),
+    m_retryTimer(0),
+    m_retryCount(0),
+    m_storesInFlight(0),
+    m_syncQueued(false),
+    m_servicesCacheValid(false),
+    m_servicesCatalogGeneration(0),
+    m_enabledServicesValid(false),
+    m_lastWatchId(0),
+    m_deletionPending(false),
+    m_deletionStoring(false)
 {
 }
 
@@ -166,21 +294,276 @@ void Account::Private::init(Account *account)
                              G_CALLBACK(&Private::on_deleted), account);
 }
 
+void Account::Private::store(Account *account)
+{
+    beginStore();
+    m_storeElapsed.start();
+    ag_account_store_async(m_account,
+                           m_cancellable,
+                           (GAsyncReadyCallback)&Private::account_store_cb,
+                           account);
+}
+
+/* Adds the changes in other to changes */
+void Account::Private::mergeChanges(Changes &changes, const Changes &other)
+{
+    Changes::const_iterator i;
+    for (i = other.constBegin(); i != other.constEnd(); i++) {
+        changes[i.key()].unite(i.value());
+    }
+}
+
+/* Hands the pending changes to a store operation */
+void Account::Private::beginStore()
+{
+    mergeChanges(m_storingChanges, m_pendingChanges);
+    m_deletionStoring = m_deletionStoring || m_deletionPending;
+    m_pendingChanges.clear();
+    m_deletionPending = false;
+}
+
+/* Forgets the changes handed to the store operations if they succeeded, or
+ * brings them back among the pending changes otherwise */
+void Account::Private::endStore(bool succeeded)
+{
+    if (!succeeded) {
+        mergeChanges(m_pendingChanges, m_storingChanges);
+        m_deletionPending = m_deletionPending || m_deletionStoring;
+    }
+    m_storingChanges.clear();
+    m_deletionStoring = false;
+}
+
+/* Returns the changes which have not been successfully stored yet */
+Account::Private::Changes Account::Private::unstoredChanges() const
+{
+    Changes changes = m_pendingChanges;
+    mergeChanges(changes, m_storingChanges);
+    return changes;
+}
+
+/* Records the change of a key of the given service (NULL for the global
+ * settings). This is on the path of every write: only the names are
+ * recorded, and nothing is allocated once the key is known. */
+void Account::Private::recordChange(AgService *service, const char *key)
+{
+    const char *serviceName = service != 0 ? ag_service_get_name(service) : "";
+    Changes::iterator i =
+        m_pendingChanges.find(QByteArray::fromRawData(serviceName,
+                                                      qstrlen(serviceName)));
+    if (i == m_pendingChanges.end()) {
+        i = m_pendingChanges.insert(QByteArray(serviceName),
+                                    QSet<QByteArray>());
+    }
+    if (!i->contains(QByteArray::fromRawData(key, qstrlen(key)))) {
+        i->insert(QByteArray(key));
+    }
+}
+
+void Account::Private::record(Statistics::Operation operation, qint64 usecs)
+{
+    if (!m_manager.isNull()) m_manager->d->record(operation, usecs);
+}
+
+/* Returns the index of the keys of the selected service */
+KeyTree &Account::Private::keyTree()
+{
+    AgService *service = ag_account_get_selected_service(m_account);
+    QString serviceName = service != 0 ?
+        UTF8(ag_service_get_name(service)) : QString();
+
+    KeyTree &tree = m_keyTrees[serviceName];
+    if (tree.isValid(m_account)) return tree;
+
+    settingsWatcher(service, serviceName);
+
+    AgAccountSettingIter iter;
+    ag_account_settings_iter_init(m_account, &iter, "");
+    tree.build(m_account, &iter);
+    return tree;
+}
+
+/* Returns the object notifying the changes in the settings of the given
+ * service: it keeps the key trees up to date and feeds the watch
+ * dispatchers */
+AgAccountService *
+Account::Private::settingsWatcher(AgService *service,
+                                  const QString &serviceName)
+{
+    AgAccountService *watcher = m_settingsWatchers.value(serviceName);
+    if (watcher != 0) return watcher;
+
+    /* An AgAccountService is the only way to be notified of any change
+     * in the settings of a service; its creation changes the selected
+     * service, though */
+    AgService *selected = ag_account_get_selected_service(m_account);
+    watcher = ag_account_service_new(m_account, service);
+    ag_account_select_service(m_account, selected);
+    g_signal_connect_swapped(watcher, "changed",
+                             G_CALLBACK(&Private::on_settings_changed),
+                             this);
+    m_settingsWatchers.insert(serviceName, watcher);
+    return watcher;
+}
+
+/* Subscribes to the changes of the given key (or group, if empty) of the
+ * selected service */
+quint32 Account::Private::addWatch(const SettingKey &key,
+                                   const WatchDispatcher::Callback &callback)
+{
+    AgService *service = ag_account_get_selected_service(m_account);
+    QString serviceName = service != 0 ?
+        UTF8(ag_service_get_name(service)) : QString();
+    settingsWatcher(service, serviceName);
+
+    WatchDispatcher *&dispatcher = m_watchDispatchers[serviceName];
+    if (dispatcher == 0) dispatcher = new WatchDispatcher;
+
+    quint32 id = ++m_lastWatchId;
+    dispatcher->addWatch(id, prefix + key.toString(), callback);
+    m_watchServices.insert(id, serviceName);
+    return id;
+}
+
+void Account::Private::removeWatch(quint32 id)
+{
+    QHash<quint32,QString>::iterator i = m_watchServices.find(id);
+    if (i == m_watchServices.end()) return;
+
+    WatchDispatcher *dispatcher = m_watchDispatchers.value(i.value());
+    if (dispatcher != 0) dispatcher->removeWatch(id);
+    m_watchServices.erase(i);
+}
+
+void Account::Private::on_settings_changed(Private *d,
+                                           AgAccountService *watcher)
+{
+    KeyTree::touch(d->m_account);
+
+    AgService *service = ag_account_service_get_service(watcher);
+    QString serviceName = service != 0 ?
+        UTF8(ag_service_get_name(service)) : QString();
+    WatchDispatcher *dispatcher = d->m_watchDispatchers.value(serviceName);
+    if (dispatcher == 0 || dispatcher->isEmpty()) return;
+
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::SignalDelivery);
+    QStringList keys;
+    gchar **changedFields = ag_account_service_get_changed_fields(watcher);
+    for (gchar **field = changedFields;
+         field != 0 && *field != 0; field++) {
+        keys.append(ASCII(*field));
+    }
+    g_strfreev(changedFields);
+
+    dispatcher->dispatch(keys);
+}
+
+/* Returns a random number between -1 and 1. The generator is seeded
+ * differently in each process and thread, so that the clients contending
+ * for the database don't retry in lockstep; qrand() can't be used, since
+ * seeding it would interfere with the application's own sequence. */
+static qreal randomVariation()
+{
+    static thread_local std::minstd_rand generator(
+        uint(QDateTime::currentMSecsSinceEpoch()) ^
+        uint(QCoreApplication::applicationPid()) ^
+        uint(quintptr(QThread::currentThreadId())));
+    std::uniform_real_distribution<qreal> distribution(-1.0, 1.0);
+    return distribution(generator);
+}
+
+/* Called when a store operation failed because the DB is locked: returns
+ * whether the operation will be retried */
+bool Account::Private::scheduleStoreRetry(Account *account)
+{
+    if (m_manager.isNull()) return false;
+    const RetryPolicy &policy = m_manager->d->m_retryPolicy;
+    if (!policy.isValid()) return false;
+
+    if (m_retryTimer != 0 && m_retryTimer->isActive()) {
+        /* Another store is already waiting for a retry, which will write
+         * the changes of this one too */
+        m_storesInFlight--;
+        return true;
+    }
+
+    if (m_retryCount == 0) {
+        m_retryElapsed.start();
+    }
+
+    qint64 delay = policy.initialDelay();
+    for (int i = 0; i < m_retryCount && delay < policy.maxDelay(); i++) {
+        delay *= 2;
+    }
+    delay = qMin(delay, qint64(policy.maxDelay()));
+    qreal variation = randomVariation() * policy.jitter();
+    delay = qMax(qint64(delay * (1.0 + variation)), qint64(1));
+
+    if (m_retryElapsed.elapsed() + delay > policy.deadline()) {
+        return false;
+    }
+
+    if (m_retryTimer == 0) {
+        m_retryTimer = new QTimer(account);
+        m_retryTimer->setSingleShot(true);
+        QObject::connect(m_retryTimer, &QTimer::timeout,
+                         account, [this, account]() { store(account); });
+    }
+    m_retryCount++;
+    m_retryTimer->start(int(delay));
+    return true;
+}
+
 void Account::Private::on_display_name_changed(Account *self)
 {
+    Manager::Private::Measurement measurement(self->d->m_manager,
+                                              Statistics::SignalDelivery);
     const gchar *name = ag_account_get_display_name(self->d->m_account);
 
     Q_EMIT self->displayNameChanged(UTF8(name));
 }
 
+/* Prepares the cache of services() and enabledServices() for use: returns
+ * false if it needs to be filled again */
+bool Account::Private::checkServicesCache()
+{
+    /* The list of supported services changes when service files are
+     * installed or removed */
+    quint32 generation = 0;
+    if (!m_manager.isNull()) {
+        m_manager->d->watchCatalogDirectories();
+        generation = m_manager->d->m_catalogGeneration;
+    }
+
+    if (m_servicesCacheValid && generation == m_servicesCatalogGeneration) {
+        return true;
+    }
+
+    m_services.clear();
+    m_enabledServices.clear();
+    m_enabledServicesValid = false;
+    m_servicesCatalogGeneration = generation;
+    m_servicesCacheValid = true;
+    return false;
+}
+
 void Account::Private::on_enabled(Account *self, const gchar *service_name,
                                   gboolean enabled)
 {
+    KeyTree::touch(self->d->m_account);
+    self->d->invalidateServices();
+    Manager::Private::Measurement measurement(self->d->m_manager,
+                                              Statistics::SignalDelivery);
     Q_EMIT self->enabledChanged(UTF8(service_name), enabled);
 }
 
 void Account::Private::on_deleted(Account *self)
 {
+    KeyTree::touch(self->d->m_account);
+    self->d->invalidateServices();
+    Manager::Private::Measurement measurement(self->d->m_manager,
+                                              Statistics::SignalDelivery);
     Q_EMIT self->removed();
 }
 
@@ -224,16 +607,31 @@ Account::Account(Private *d, QObject *parent):
  */
 Account *Account::fromId(Manager *manager, AccountId id, QObject *parent)
 {
-    GError *error = 0;
-    AgAccount *account = ag_manager_load_account(manager->d->m_manager, id,
-                                                 &error);
+    Error error;
+    Account *account = load(manager, id, parent, &error);
     if (account == 0) {
-        Q_ASSERT(error != 0);
-        manager->d->lastError = Error(error);
-        g_error_free(error);
+        manager->d->lastError = error;
+    }
+    return account;
+}
+
+/* Same as fromId(), but the error is reported to the caller instead of being
+ * stored in the Manager's lastError. */
+Account *Account::load(Manager *manager, AccountId id, QObject *parent,
+                       Error *error)
+{
+    Manager::Private::Measurement measurement(manager,
+                                              Statistics::LoadAccount);
+    GError *gError = 0;
+    AgAccount *account = ag_manager_load_account(manager->d->backend(), id,
+                                                 &gError);
+    if (account == 0) {
+        Q_ASSERT(gError != 0);
+        *error = Error(gError);
+        g_error_free(gError);
         return 0;
     }
-    Q_ASSERT(error == 0);
+    Q_ASSERT(gError == 0);
     return new Account(new Private(manager, account), parent);
 }
 
@@ -297,6 +695,12 @@ bool Account::supportsService(const QString &serviceType) const
  */
 ServiceList Account::services(const QString &serviceType) const
 {
+    if (d->checkServicesCache()) {
+        QHash<QString,ServiceList>::const_iterator i =
+            d->m_services.constFind(serviceType);
+        if (i != d->m_services.constEnd()) return i.value();
+    }
+
     GList *list;
     if (serviceType.isEmpty()) {
         list = ag_account_list_services(d->m_account);
@@ -316,6 +720,7 @@ ServiceList Account::services(const QString &serviceType) const
 
     g_list_free(list);
 
+    d->m_services.insert(serviceType, servList);
     return servList;
 }
 
@@ -323,9 +728,16 @@ ServiceList Account::services(const QString &serviceType) const
  * Returns a list of enabled services supported by this account. If the manager
  * was constructed with given service type only the services which supports the
  * service type will be returned.
+ *
+ * The list is cached, and only computed again after the enabled state of
+ * some service of the account has changed.
  */
 ServiceList Account::enabledServices() const
 {
+    if (d->checkServicesCache() && d->m_enabledServicesValid) {
+        return d->m_enabledServices;
+    }
+
     GList *list;
     list = ag_account_list_enabled_services(d->m_account);
 
@@ -340,6 +752,8 @@ ServiceList Account::enabledServices() const
 
     g_list_free(list);
 
+    d->m_enabledServices = servList;
+    d->m_enabledServicesValid = true;
     return servList;
 }
 
@@ -378,7 +792,9 @@ bool Account::isEnabled() const
  */
 void Account::setEnabled(bool enabled)
 {
+    d->recordChange(ag_account_get_selected_service(d->m_account), "enabled");
     ag_account_set_enabled(d->m_account, enabled);
+    KeyTree::touch(d->m_account);
 }
 
 /*!
@@ -397,6 +813,7 @@ QString Account::displayName() const
  */
 void Account::setDisplayName(const QString &displayName)
 {
+    d->recordChange(0, "name");
     ag_account_set_display_name(d->m_account,
                                 displayName.toUtf8().constData());
 }
@@ -430,7 +847,7 @@ void Account::selectService(const Service &service)
         agService = service.service();
 
     ag_account_select_service(d->m_account, agService);
-    d->prefix = QString();
+    d->setPrefix(QString());
 }
 
 /*!
@@ -455,8 +872,8 @@ QStringList Account::allKeys() const
     GVariant *val;
 
     /* iterate the settings */
-    QByteArray tmp = d->prefix.toLatin1();
-    ag_account_settings_iter_init(d->m_account, &iter, tmp.constData());
+    ag_account_settings_iter_init(d->m_account, &iter,
+                                  d->prefixLatin1.constData());
     while (ag_account_settings_iter_get_next(&iter, &key, &val))
     {
         allKeys.append(QString(ASCII(key)));
@@ -472,7 +889,7 @@ QStringList Account::allKeys() const
  */
 void Account::beginGroup(const QString &prefix)
 {
-    d->prefix += prefix + slash;
+    d->setPrefix(d->prefix + prefix + slash);
 }
 
 /*!
@@ -482,18 +899,7 @@ void Account::beginGroup(const QString &prefix)
  */
 QStringList Account::childGroups() const
 {
-    QStringList groups, all_keys;
-
-    all_keys = allKeys();
-    Q_FOREACH (const QString &key, all_keys)
-    {
-        if (key.contains(slash)) {
-            QString group = key.section(slash, 0, 0);
-            if (!groups.contains(group))
-                groups.append(group);
-        }
-    }
-    return groups;
+    return d->keyTree().childGroups(d->prefix);
 }
 
 /*!
@@ -503,15 +909,7 @@ QStringList Account::childGroups() const
  */
 QStringList Account::childKeys() const
 {
-    QStringList keys, all_keys;
-
-    all_keys = allKeys();
-    Q_FOREACH (const QString &key, all_keys)
-    {
-        if (!key.contains(slash))
-            keys.append(key);
-    }
-    return keys;
+    return d->keyTree().childKeys(d->prefix);
 }
 
 /*!
@@ -523,9 +921,9 @@ void Account::clear()
     /* clear() must ignore the group: so, temporarily reset it and call
      * remove("") */
     QString saved_prefix = d->prefix;
-    d->prefix = QString();
+    d->setPrefix(QString());
     remove(QString());
-    d->prefix = saved_prefix;
+    d->setPrefix(saved_prefix);
 }
 
 /*!
@@ -536,7 +934,7 @@ void Account::clear()
  */
 bool Account::contains(const QString &key) const
 {
-    return childKeys().contains(key);
+    return d->keyTree().containsKey(d->prefix, key);
 }
 
 /*!
@@ -546,9 +944,10 @@ bool Account::contains(const QString &key) const
  */
 void Account::endGroup()
 {
-    d->prefix = d->prefix.section(slash, 0, -3,
-                                  QString::SectionIncludeTrailingSep);
-    if (d->prefix[0] == slash) d->prefix.remove(0, 1);
+    QString prefix = d->prefix.section(slash, 0, -3,
+                                       QString::SectionIncludeTrailingSep);
+    if (prefix[0] == slash) prefix.remove(0, 1);
+    d->setPrefix(prefix);
 }
 
 /*!
@@ -592,12 +991,33 @@ void Account::remove(const QString &key)
     }
     else
     {
-        QString full_key = d->prefix + key;
-        QByteArray tmpkey = full_key.toLatin1();
-        ag_account_set_variant(d->m_account, tmpkey.constData(), NULL);
+        remove(SettingKey(key));
     }
 }
 
+/*!
+ * Removes the given key.
+ * @param key The key name of the settings; if empty, all keys in the
+ * current group are removed.
+ *
+ * This method operates on the currently selected service.
+ */
+void Account::remove(const SettingKey &key)
+{
+    if (key.isEmpty()) {
+        remove(QString());
+        return;
+    }
+
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::WriteValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    d->recordChange(ag_account_get_selected_service(d->m_account),
+                    fullKey.constData());
+    ag_account_set_variant(d->m_account, fullKey.constData(), NULL);
+    KeyTree::touch(d->m_account);
+}
+
 /*!
  * Changes the value of an account setting.
  * @param key The key name of the setting.
@@ -607,14 +1027,60 @@ void Account::remove(const QString &key)
  */
 void Account::setValue(const QString &key, const QVariant &value)
 {
+    setValue(SettingKey(key), value);
+}
+
+/*!
+ * Changes the value of an account setting.
+ * @param key The key name of the setting.
+ * @param value The new value.
+ *
+ * This method operates on the currently selected service.
+ */
+void Account::setValue(const SettingKey &key, const QVariant &value)
+{
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::WriteValue);
     GVariant *variant = qVariantToGVariant(value);
     if (variant == 0) {
         return;
     }
 
-    QString full_key = d->prefix + key;
-    QByteArray tmpkey = full_key.toLatin1();
-    ag_account_set_variant(d->m_account, tmpkey.constData(), variant);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    d->recordChange(ag_account_get_selected_service(d->m_account),
+                    fullKey.constData());
+    ag_account_set_variant(d->m_account, fullKey.constData(), variant);
+    KeyTree::touch(d->m_account);
+}
+
+/*!
+ * Changes the value of several account settings.
+ * @param values The new values, indexed by key name.
+ *
+ * This is equivalent to calling setValue() on each element of \a values,
+ * but more efficient. Elements whose value cannot be converted are ignored.
+ *
+ * This method operates on the currently selected service.
+ */
+void Account::setValues(const QVariantMap &values)
+{
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::WriteValue);
+    QByteArray fullKey = d->prefixLatin1;
+    const int prefixLength = fullKey.length();
+    AgService *service = ag_account_get_selected_service(d->m_account);
+
+    QVariantMap::const_iterator i;
+    for (i = values.constBegin(); i != values.constEnd(); i++) {
+        GVariant *variant = qVariantToGVariant(i.value());
+        if (variant == 0) continue;
+
+        fullKey.truncate(prefixLength);
+        fullKey.append(i.key().toLatin1());
+        d->recordChange(service, fullKey.constData());
+        ag_account_set_variant(d->m_account, fullKey.constData(), variant);
+    }
+    KeyTree::touch(d->m_account);
 }
 
 void Account::Private::account_store_cb(AgAccount *account,
@@ -623,15 +1089,48 @@ void Account::Private::account_store_cb(AgAccount *account,
 {
     GError *error = NULL;
     ag_account_store_finish(account, res, &error);
-    if (error) {
-        if (error->domain == G_IO_ERROR &&
-            error->code == G_IO_ERROR_CANCELLED) {
-        } else {
+    if (error != NULL && error->domain == G_IO_ERROR &&
+        error->code == G_IO_ERROR_CANCELLED) {
+        /* The store was cancelled by cancelSync() or because the Account
+         * has been deleted: in the latter case, self is a dangling
+         * pointer and must not be touched */
+        g_error_free(error);
+        return;
+    }
+
+    qint64 usecs = self->d->m_storeElapsed.nsecsElapsed() / 1000;
+    self->d->record(Statistics::StoreAsync, usecs);
+    bool dbLocked = error != NULL &&
+        error->domain == AG_ERRORS && error->code == AG_ERROR_DB_LOCKED;
+    if (dbLocked) {
+        self->d->record(Statistics::LockWait, usecs);
+    }
+    if (dbLocked && self->d->scheduleStoreRetry(self)) {
+        // the operation will be retried later
+    } else if (self->d->m_syncQueued) {
+        /* Further sync() calls have been merged while this operation was
+         * running: a single store writes their changes and reports the
+         * result for all of them */
+        self->d->m_syncQueued = false;
+        self->d->m_retryCount = 0;
+        self->d->store(self);
+    } else {
+        self->d->m_retryCount = 0;
+        self->d->m_storesInFlight--;
+        /* On success, the changes handed to the other stores in progress
+         * are only confirmed when these complete */
+        if (error != NULL || self->d->m_storesInFlight == 0) {
+            self->d->endStore(error == NULL);
+        }
+        if (error) {
             Q_EMIT self->error(Error(error));
+        } else {
+            Q_EMIT self->synced();
         }
+    }
+
+    if (error) {
         g_error_free(error);
-    } else {
-        Q_EMIT self->synced();
     }
 }
 
@@ -652,11 +1151,30 @@ void Account::Private::account_store_cb(AgAccount *account,
 QVariant Account::value(const QString &key, const QVariant &defaultValue,
                         SettingSource *source) const
 {
-    QString full_key = d->prefix + key;
-    QByteArray ba = full_key.toLatin1();
+    return value(SettingKey(key), defaultValue, source);
+}
+
+/*!
+ * Retrieves the value of an account setting, as a QVariant.
+ * @param key The key whose value must be retrieved.
+ * @param defaultValue Value returned if the key is unset.
+ * @param source Indicates whether the value comes from the account, the
+ * service template or was unset.
+ *
+ * @return The value associated to \a key.
+ *
+ * This method operates on the currently selected service.
+ */
+QVariant Account::value(const SettingKey &key, const QVariant &defaultValue,
+                        SettingSource *source) const
+{
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::ReadValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
     AgSettingSource settingSource;
     GVariant *variant =
-        ag_account_get_variant(d->m_account, ba.constData(), &settingSource);
+        ag_account_get_variant(d->m_account, fullKey.constData(),
+                               &settingSource);
     if (source != 0) {
         switch (settingSource) {
         case AG_SETTING_SOURCE_ACCOUNT: *source = ACCOUNT; break;
@@ -710,11 +1228,7 @@ QString Account::valueAsString(const QString &key,
                                QString default_value,
                                SettingSource *source) const
 {
-    QVariant var = default_value;
-    SettingSource src = value(key, var);
-    if (source)
-        *source = src;
-    return var.toString();
+    return value<QString>(key, default_value, source);
 }
 
 /*!
@@ -730,11 +1244,7 @@ int Account::valueAsInt(const QString &key,
                         int default_value,
                         SettingSource *source) const
 {
-    QVariant var = default_value;
-    SettingSource src = value(key, var);
-    if (source)
-        *source = src;
-    return var.toInt();
+    return value<int>(key, default_value, source);
 }
 
 /*!
@@ -750,11 +1260,7 @@ quint64 Account::valueAsUInt64(const QString &key,
                         quint64 default_value,
                         SettingSource *source) const
 {
-    QVariant var = default_value;
-    SettingSource src = value(key, var);
-    if (source)
-        *source = src;
-    return var.toULongLong();
+    return value<quint64>(key, default_value, source);
 }
 
 /*!
@@ -770,19 +1276,223 @@ bool Account::valueAsBool(const QString &key,
                           bool default_value,
                           SettingSource *source) const
 {
-    QVariant var = default_value;
-    SettingSource src = value(key, var);
-    if (source)
-        *source = src;
-    return var.toBool();
+    return value<bool>(key, default_value, source);
+}
+
+/*!
+ * @fn T Account::value(const QString &key, const T &defaultValue, SettingSource *source) const
+ * Retrieves the value of an account setting, converted to the type \a T.
+ * @param key The key whose value must be retrieved.
+ * @param defaultValue Value returned if the key is unset, or if its value
+ * cannot be converted.
+ * @param source Indicates whether the value comes from the account, the
+ * service template or was unset.
+ *
+ * The value is read directly from the stored setting, without building a
+ * QVariant, unless a conversion between different types is needed. The
+ * supported types are int, uint, qint64, quint64, bool, QString and
+ * QStringList. The template parameter must always be given explicitly:
+ * \code
+ * int port = account->value<int>("port", 143);
+ * \endcode
+ *
+ * This method operates on the currently selected service.
+ */
+template <typename T>
+T Account::value(const QString &key,
+                 const typename NonDeduced<T>::Type &defaultValue,
+                 SettingSource *source) const
+{
+    return value<T>(SettingKey(key), defaultValue, source);
+}
+
+/*!
+ * @fn T Account::value(const SettingKey &key, const T &defaultValue, SettingSource *source) const
+ * Retrieves the value of an account setting, converted to the type \a T.
+ * @see value(const QString &key, const T &defaultValue, SettingSource *source) const
+ */
+template <typename T>
+T Account::value(const SettingKey &key,
+                 const typename NonDeduced<T>::Type &defaultValue,
+                 SettingSource *source) const
+{
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::ReadValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    AgSettingSource settingSource;
+    GVariant *variant =
+        ag_account_get_variant(d->m_account, fullKey.constData(),
+                               &settingSource);
+    if (source != 0) {
+        switch (settingSource) {
+        case AG_SETTING_SOURCE_ACCOUNT: *source = ACCOUNT; break;
+        case AG_SETTING_SOURCE_PROFILE: *source = TEMPLATE; break;
+        default: *source = NONE; break;
+        }
+    }
+
+    if (variant == 0) return defaultValue;
+
+    T result;
+    if (!gVariantToValue(variant, &result)) {
+        if (source != 0) *source = NONE;
+        return defaultValue;
+    }
+    return result;
 }
 
-void Watch::Private::account_notify_cb(AgAccount *account, const gchar *key,
-                                       Watch *watch)
+// \cond
+template int Account::value<int>(const QString &, const int &,
+                                 SettingSource *) const;
+template uint Account::value<uint>(const QString &, const uint &,
+                                   SettingSource *) const;
+template qint64 Account::value<qint64>(const QString &, const qint64 &,
+                                       SettingSource *) const;
+template quint64 Account::value<quint64>(const QString &, const quint64 &,
+                                         SettingSource *) const;
+template bool Account::value<bool>(const QString &, const bool &,
+                                   SettingSource *) const;
+template QString Account::value<QString>(const QString &, const QString &,
+                                         SettingSource *) const;
+template QStringList
+Account::value<QStringList>(const QString &, const QStringList &,
+                            SettingSource *) const;
+template int Account::value<int>(const SettingKey &, const int &,
+                                 SettingSource *) const;
+template uint Account::value<uint>(const SettingKey &, const uint &,
+                                   SettingSource *) const;
+template qint64 Account::value<qint64>(const SettingKey &, const qint64 &,
+                                       SettingSource *) const;
+template quint64 Account::value<quint64>(const SettingKey &, const quint64 &,
+                                         SettingSource *) const;
+template bool Account::value<bool>(const SettingKey &, const bool &,
+                                   SettingSource *) const;
+template QString Account::value<QString>(const SettingKey &, const QString &,
+                                         SettingSource *) const;
+template QStringList
+Account::value<QStringList>(const SettingKey &, const QStringList &,
+                            SettingSource *) const;
+// \endcond
+
+/*!
+ * Retrieves the values of several account settings.
+ * @param keys The keys whose values must be retrieved.
+ *
+ * @return The values of the given keys, indexed by key name; unset keys are
+ * not included in the map.
+ *
+ * This is equivalent to calling value() on each element of \a keys, but
+ * more efficient.
+ *
+ * This method operates on the currently selected service.
+ */
+QVariantMap Account::values(const QStringList &keys) const
 {
-    Q_EMIT watch->notify(key);
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::ReadValue);
+    QVariantMap values;
+    QByteArray fullKey = d->prefixLatin1;
+    const int prefixLength = fullKey.length();
+
+    Q_FOREACH (const QString &key, keys) {
+        fullKey.truncate(prefixLength);
+        fullKey.append(key.toLatin1());
+        GVariant *variant =
+            ag_account_get_variant(d->m_account, fullKey.constData(), NULL);
+        if (variant != 0) {
+            values.insert(key, gVariantToQVariant(variant));
+        }
+    }
+    return values;
+}
 
-    Q_UNUSED(account);
+/*!
+ * Retrieves the value of a setting of a service, falling back to the
+ * global account settings.
+ * @param key The key whose value must be retrieved.
+ * @param service The service; if invalid, the currently selected service is
+ * used.
+ * @param defaultValue Value returned if the key is unset.
+ * @param source Indicates whether the value comes from the account (either
+ * from the service or from the global settings) or from the templates.
+ *
+ * The value is looked up in the account settings of the service first, then
+ * in the global account settings, and finally in the default settings
+ * defined by the service and by the provider. Unlike switching services
+ * with selectService(), this leaves the selected service and the current
+ * group as they were: the services are only selected on the underlying
+ * account object for the time needed to read the values, and no watch is
+ * notified of the switch.
+ *
+ * @return The value of the setting, or @p defaultValue.
+ */
+QVariant Account::valueWithFallback(const QString &key,
+                                    const Service &service,
+                                    const QVariant &defaultValue,
+                                    SettingSource *source) const
+{
+    return valueWithFallback(SettingKey(key), service, defaultValue, source);
+}
+
+/*!
+ * Retrieves the value of a setting of a service, falling back to the
+ * global account settings.
+ * @overload
+ */
+QVariant Account::valueWithFallback(const SettingKey &key,
+                                    const Service &service,
+                                    const QVariant &defaultValue,
+                                    SettingSource *source) const
+{
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::ReadValue);
+    KeyBuffer fullKey(d->prefixLatin1, key);
+    AgService *selected = ag_account_get_selected_service(d->m_account);
+    AgService *agService = service.isValid() ? service.service() : selected;
+
+    AgSettingSource serviceSource = AG_SETTING_SOURCE_NONE;
+    AgSettingSource globalSource = AG_SETTING_SOURCE_NONE;
+    GVariant *serviceVariant = 0;
+    GVariant *globalVariant = 0;
+
+    /* libaccounts-glib can only read the settings of the selected service
+     * (an AgAccountService selects its service too): switch service for the
+     * time of the reads, and switch back */
+    if (agService != selected) {
+        ag_account_select_service(d->m_account, agService);
+    }
+    serviceVariant = ag_account_get_variant(d->m_account, fullKey.constData(),
+                                            &serviceSource);
+    if (agService != 0 && serviceSource != AG_SETTING_SOURCE_ACCOUNT) {
+        ag_account_select_service(d->m_account, NULL);
+        globalVariant = ag_account_get_variant(d->m_account,
+                                               fullKey.constData(),
+                                               &globalSource);
+    }
+    if (ag_account_get_selected_service(d->m_account) != selected) {
+        ag_account_select_service(d->m_account, selected);
+    }
+
+    GVariant *variant;
+    AgSettingSource settingSource;
+    if (serviceSource == AG_SETTING_SOURCE_ACCOUNT ||
+        (globalSource != AG_SETTING_SOURCE_ACCOUNT && serviceVariant != 0)) {
+        variant = serviceVariant;
+        settingSource = serviceSource;
+    } else {
+        variant = globalVariant;
+        settingSource = globalSource;
+    }
+
+    if (source != 0) {
+        switch (settingSource) {
+        case AG_SETTING_SOURCE_ACCOUNT: *source = ACCOUNT; break;
+        case AG_SETTING_SOURCE_PROFILE: *source = TEMPLATE; break;
+        default: *source = NONE; break;
+        }
+    }
+
+    return (variant != 0) ? gVariantToQVariant(variant) : defaultValue;
 }
 
 /*!
@@ -797,31 +1507,162 @@ void Watch::Private::account_notify_cb(AgAccount *account, const gchar *key,
  */
 Watch *Account::watchKey(const QString &key)
 {
-    AgAccountWatch ag_watch;
-    Watch *watch = new Watch(this);
+    return watchKey(SettingKey(key));
+}
 
-    if (!key.isEmpty())
-    {
-        QString full_key = d->prefix + key;
-        ag_watch = ag_account_watch_key
-            (d->m_account, full_key.toLatin1().constData(),
-             (AgAccountNotifyCb)&Watch::Private::account_notify_cb, watch);
+/*!
+ * Installs a key or group watch.
+ *
+ * @param key The key to watch; if empty, watches the currently selected
+ * group.
+ *
+ * @return A watch object.
+ *
+ * This method operates on the currently selected service.
+ */
+Watch *Account::watchKey(const SettingKey &key)
+{
+    return d->createWatch(this, key, -1);
+}
+
+/*!
+ * Installs a key or group watch delivering its notifications in batches.
+ *
+ * @param key The key to watch; if empty, watches the currently selected
+ * group.
+ * @param batchInterval Time, in milliseconds, during which the changes are
+ * collected after the first one is notified; 0 means that the changes are
+ * delivered when control returns to the event loop.
+ *
+ * All the changes happening within the interval are delivered with a single
+ * Watch::changed() signal (preceded by a single Watch::notify() signal),
+ * which carries the new values of the changed keys; thus, storing many keys
+ * of a watched group does not cause the group to be read again for each of
+ * them.
+ *
+ * @return A watch object.
+ *
+ * This method operates on the currently selected service.
+ */
+Watch *Account::watchKey(const SettingKey &key, int batchInterval)
+{
+    return d->createWatch(this, key, qMax(batchInterval, 0));
+}
+
+/*!
+ * Installs a key or group watch delivering its notifications in batches.
+ * @overload
+ */
+Watch *Account::watchKey(const QString &key, int batchInterval)
+{
+    return watchKey(SettingKey(key), batchInterval);
+}
+
+/* Creates a watch on the selected service; if batchInterval is negative,
+ * the changes are delivered as soon as they are notified */
+Watch *Account::Private::createWatch(Account *account, const SettingKey &key,
+                                     int batchInterval)
+{
+    Watch *watch = new Watch(account);
+    watch->d = new Watch::Private(ag_account_get_selected_service(m_account),
+                                  prefixLatin1 + key.toLatin1());
+
+    if (batchInterval >= 0) {
+        QTimer *timer = new QTimer(watch);
+        timer->setSingleShot(true);
+        timer->setInterval(batchInterval);
+        QObject::connect(timer, &QTimer::timeout, watch, [this, watch]() {
+            QStringList keys = watch->d->pendingKeys;
+            watch->d->pendingKeys.clear();
+            deliverChanges(watch, keys);
+        });
+        watch->d->timer = timer;
     }
-    else
-    {
-        ag_watch = ag_account_watch_dir
-            (d->m_account, d->prefix.toLatin1().constData(),
-             (AgAccountNotifyCb)&Watch::Private::account_notify_cb, watch);
+
+    watch->d->id = addWatch(key, [this, watch](const QStringList &keys) {
+        queueChanges(watch, keys);
+    });
+    return watch;
+}
+
+void Account::Private::queueChanges(Watch *watch, const QStringList &keys)
+{
+    QTimer *timer = watch->d->timer;
+    if (timer == 0) {
+        deliverChanges(watch, keys);
+        return;
     }
 
-    if (!ag_watch)
-    {
-        delete watch;
-        return NULL;
+    Q_FOREACH (const QString &key, keys) {
+        if (!watch->d->pendingKeys.contains(key)) {
+            watch->d->pendingKeys.append(key);
+        }
     }
+    if (!timer->isActive()) timer->start();
+}
 
-    watch->setWatch(ag_watch);
-    return watch;
+void Account::Private::deliverChanges(Watch *watch, const QStringList &keys)
+{
+    /* The slots might delete the watch */
+    QPointer<Watch> guard(watch);
+    Q_EMIT watch->notify(watch->d->key.constData());
+    if (guard.isNull()) return;
+
+    /* Reading the values is only worth it if someone wants them */
+    if (!Watch::Private::isChangedConnected(watch)) return;
+
+    /* Read the values from the service of the watch, without altering the
+     * selected service */
+    AgService *selected = ag_account_get_selected_service(m_account);
+    ag_account_select_service(m_account, watch->d->service);
+    QVariantMap values;
+    Q_FOREACH (const QString &key, keys) {
+        GVariant *variant = ag_account_get_variant(m_account,
+                                                   key.toLatin1().constData(),
+                                                   NULL);
+        values.insert(key, variant != 0 ?
+                      gVariantToQVariant(variant) : QVariant());
+    }
+    ag_account_select_service(m_account, selected);
+
+    if (guard.isNull()) return;
+    Q_EMIT watch->changed(values);
+}
+
+/*!
+ * Installs a key or group watch invoking a callback, without creating a
+ * Watch object.
+ *
+ * @param key The key to watch; if empty, watches the currently selected
+ * group. A key ending with a slash watches the group with that name, inside
+ * the currently selected group.
+ * @param callback The function invoked when some of the watched keys
+ * change; it receives the full names of the changed keys, and it is
+ * invoked once for all the keys written by the same store operation.
+ *
+ * All the watches of an account are served by a single notification from
+ * the accounts database, so installing many of them is cheap.
+ *
+ * @return An identifier for the watch, to be passed to removeWatch().
+ *
+ * This method operates on the currently selected service.
+ */
+quint32 Account::addWatch(const QString &key,
+                          const std::function<void(const QStringList &)>
+                          &callback)
+{
+    return d->addWatch(SettingKey(key), callback);
+}
+
+/*!
+ * Removes a watch installed with addWatch(). The watches still installed
+ * when the account object is destroyed are removed automatically.
+ *
+ * @param id The identifier returned by addWatch().
+ */
+void Account::removeWatch(quint32 id)
+{
+    d->removeWatch(id);
 }
 
 /*!
@@ -835,13 +1676,31 @@ Watch *Account::watchKey(const QString &key)
  * If for some reason one would want to process the signals asynchronously
  * from the event loop, one can use the Qt::QueuedConnection connection
  * type as last parameter of the QObject::connect call.
+ *
+ * If the database is locked and a retry policy has been set with
+ * Manager::setRetryPolicy(), the operation is retried according to the
+ * policy before emitting error().
+ *
+ * If Manager::setSyncCoalescing() has been enabled, calls made while a
+ * store operation is in progress are merged into one.
  */
 void Account::sync()
 {
-    ag_account_store_async(d->m_account,
-                           d->m_cancellable,
-                           (GAsyncReadyCallback)&Private::account_store_cb,
-                           this);
+    if (d->m_storesInFlight > 0 && !d->m_manager.isNull() &&
+        d->m_manager->d->m_syncCoalescing) {
+        d->m_syncQueued = true;
+        return;
+    }
+
+    /* A new store operation supersedes any pending retry */
+    if (d->m_retryTimer != 0 && d->m_retryTimer->isActive()) {
+        d->m_retryTimer->stop();
+        d->m_storesInFlight--;
+    }
+    d->m_retryCount = 0;
+
+    d->m_storesInFlight++;
+    d->store(this);
 }
 
 /*!
@@ -853,26 +1712,238 @@ void Account::sync()
  */
 bool Account::syncAndBlock()
 {
-    GError *error = NULL;
+    return syncAndBlock(-1);
+}
+
+/*!
+ * Blocking version of the sync() method, waiting at most @p timeout
+ * milliseconds for the database lock.
+ * @param timeout The maximum time to wait for the database to be unlocked,
+ * in milliseconds; 0 means that the operation fails immediately if the
+ * database is locked, and a negative value means that the timeout set with
+ * Manager::setTimeout() is used.
+ * @param error If not NULL, set to the error which occurred, if any. If the
+ * lock could not be acquired in time, the error type is
+ * Error::DatabaseLocked.
+ *
+ * Unlike syncAndBlock(), this method never aborts the application when the
+ * timeout expires, regardless of Manager::setAbortOnTimeout().
+ *
+ * The timeout and the abort flag are properties of the connection to the
+ * database, which is shared by all the accounts of the Manager and, with
+ * the Manager::ShareBackend option, by all the managers of the thread with
+ * the same options: they are overridden for the duration of this call, and
+ * restored before it returns. Since the connection is never shared with
+ * other threads, and the thread is blocked meanwhile, the other users of
+ * the connection never see the overridden values; however, a call to
+ * Manager::setTimeout() or Manager::setAbortOnTimeout() made from a slot
+ * invoked during this call (for instance, by a watch) would be reverted.
+ *
+ * @return True on success, false otherwise.
+ */
+bool Account::syncAndBlock(int timeout, Error *error)
+{
+    GError *gerror = NULL;
     bool ret;
 
-    ret = ag_account_store_blocking(d->m_account, &error);
-    if (error)
+    /* The timeout is a property of the backend, shared among all the
+     * accounts of the manager and possibly among the managers of this
+     * thread: override it just for this operation */
+    AgManager *manager = ag_account_get_manager(d->m_account);
+    guint oldTimeout = ag_manager_get_db_timeout(manager);
+    gboolean oldAbort = ag_manager_get_abort_on_db_timeout(manager);
+    if (timeout >= 0) {
+        ag_manager_set_db_timeout(manager, guint(timeout));
+        ag_manager_set_abort_on_db_timeout(manager, FALSE);
+    }
+
+    d->beginStore();
+    QElapsedTimer timer;
+    timer.start();
+    ret = ag_account_store_blocking(d->m_account, &gerror);
+    d->endStore(ret);
+    qint64 usecs = timer.nsecsElapsed() / 1000;
+    d->record(Statistics::StoreBlocking, usecs);
+
+    if (timeout >= 0) {
+        ag_manager_set_db_timeout(manager, oldTimeout);
+        ag_manager_set_abort_on_db_timeout(manager, oldAbort);
+    }
+
+    if (gerror)
     {
-        qWarning() << "Store operation failed: " << error->message;
-        g_error_free(error);
+        if (gerror->domain == AG_ERRORS &&
+            gerror->code == AG_ERROR_DB_LOCKED) {
+            d->record(Statistics::LockWait, usecs);
+        }
+        qWarning() << "Store operation failed: " << gerror->message;
+        if (error != 0) *error = Error(gerror);
+        g_error_free(gerror);
+    } else if (error != 0) {
+        *error = Error();
     }
 
     return ret;
 }
 
+/*!
+ * Checks whether the account has been modified since it was last
+ * successfully stored.
+ *
+ * This is a cheap check, which allows skipping store operations which would
+ * not write anything. An account which has never been stored is always
+ * considered modified.
+ *
+ * @return Whether calling sync() would write some change.
+ * @see pendingChanges()
+ */
+bool Account::hasPendingChanges() const
+{
+    if (d->m_deletionPending || d->m_deletionStoring || id() == 0) {
+        return true;
+    }
+
+    Q_FOREACH (const QSet<QByteArray> &keys, d->m_pendingChanges) {
+        if (!keys.isEmpty()) return true;
+    }
+    Q_FOREACH (const QSet<QByteArray> &keys, d->m_storingChanges) {
+        if (!keys.isEmpty()) return true;
+    }
+    return false;
+}
+
+/*!
+ * Lists the changes which have not been stored yet.
+ *
+ * @return The full names of the modified keys, indexed by the name of their
+ * service; the changes to the global account settings are listed under an
+ * empty service name. As in libaccounts-glib, the enabled state is reported
+ * as the "enabled" key of its service, and the display name as the "name"
+ * key of the global settings.
+ *
+ * The deletion of the account, requested with remove(), is only reported by
+ * hasPendingChanges().
+ */
+QMap<QString,QStringList> Account::pendingChanges() const
+{
+    QMap<QString,QStringList> changes;
+    const Private::Changes unstored = d->unstoredChanges();
+    Private::Changes::const_iterator i;
+    for (i = unstored.constBegin(); i != unstored.constEnd(); i++) {
+        if (i.value().isEmpty()) continue;
+        QStringList keys;
+        Q_FOREACH (const QByteArray &key, i.value()) {
+            keys.append(QString::fromLatin1(key));
+        }
+        keys.sort();
+        changes.insert(UTF8(i.key().constData()), keys);
+    }
+    return changes;
+}
+
+/*!
+ * Reverts the changes which have not been stored yet:
+ * the modified settings, the enabled state and the display name get back
+ * the values they have in the database.
+ *
+ * libaccounts-glib offers no way to drop the changes queued on an account:
+ * the stored values are read again and written back instead, so that
+ * calling sync() afterwards leaves the account as it was. The deletion of the account,
+ * requested with remove(), cannot be reverted.
+ */
+void Account::discardChanges()
+{
+    /* The original values are those in the database, read through a
+     * separate backend, which does not share our account object */
+    AgAccount *stored = 0;
+    if (id() != 0) {
+        AgManager *backend = ag_manager_new();
+        stored = ag_manager_load_account(backend, id(), NULL);
+        g_object_unref(backend);
+    }
+
+    AgService *selected = ag_account_get_selected_service(d->m_account);
+    AgManager *manager = ag_account_get_manager(d->m_account);
+
+    const Private::Changes unstored = d->unstoredChanges();
+    Private::Changes::const_iterator i;
+    for (i = unstored.constBegin(); i != unstored.constEnd(); i++) {
+        const QByteArray &serviceName = i.key();
+        AgService *service = serviceName.isEmpty() ? 0 :
+            ag_manager_get_service(manager, serviceName.constData());
+        if (!serviceName.isEmpty() && service == 0) continue;
+        ag_account_select_service(d->m_account, service);
+        if (stored != 0) ag_account_select_service(stored, service);
+
+        Q_FOREACH (const QByteArray &key, i.value()) {
+            if (key == "enabled") {
+                ag_account_set_enabled(d->m_account, stored != 0 &&
+                                       ag_account_get_enabled(stored));
+            } else if (service == 0 && key == "name") {
+                ag_account_set_display_name(d->m_account, stored != 0 ?
+                    ag_account_get_display_name(stored) : NULL);
+            } else {
+                /* Default values from the service files are not account
+                 * values */
+                AgSettingSource source = AG_SETTING_SOURCE_NONE;
+                GVariant *original = stored != 0 ?
+                    ag_account_get_variant(stored, key.constData(),
+                                           &source) : NULL;
+                ag_account_set_variant(d->m_account, key.constData(),
+                                       source == AG_SETTING_SOURCE_ACCOUNT ?
+                                       original : NULL);
+            }
+        }
+
+        if (service != 0) ag_service_unref(service);
+    }
+    if (stored != 0) g_object_unref(stored);
+
+    ag_account_select_service(d->m_account, selected);
+    d->m_pendingChanges.clear();
+    d->m_storingChanges.clear();
+    KeyTree::touch(d->m_account);
+}
+
+/*!
+ * Cancels the store operation started by sync(), if any, together with any
+ * pending retry or merged sync() call. The error() signal is emitted with
+ * an error of type Error::Cancelled.
+ *
+ * Note that the changes might have already been written to the database by
+ * the time this method is called; cancelling only guarantees that no
+ * further attempts are made and that no other signal is emitted for the
+ * operation.
+ */
+void Account::cancelSync()
+{
+    if (d->m_storesInFlight == 0) return;
+
+    /* The callback of the cancelled operation will not touch the account
+     * object: a new cancellable is needed for the next operations */
+    g_cancellable_cancel(d->m_cancellable);
+    g_object_unref(d->m_cancellable);
+    d->m_cancellable = g_cancellable_new();
+
+    if (d->m_retryTimer != 0) d->m_retryTimer->stop();
+    d->m_retryCount = 0;
+    d->m_storesInFlight = 0;
+    d->m_syncQueued = false;
+    d->endStore(false);
+
+    Q_EMIT error(Error(Error::Cancelled,
+                       QStringLiteral("Store operation cancelled")));
+}
+
 /*!
  * Marks the account for removal.
  * The account will be deleted only when the sync() method is called.
  */
 void Account::remove()
 {
+    d->m_deletionPending = true;
     ag_account_delete(d->m_account);
+    KeyTree::touch(d->m_account);
 }
 
 /*!
@@ -887,6 +1958,7 @@ void Account::remove()
 void Account::sign(const QString &key, const char *token)
 {
     ag_account_sign (d->m_account, key.toUtf8().constData(), token);
+    KeyTree::touch(d->m_account);
 }
 
 /*!
@@ -934,20 +2006,26 @@ bool Account::verifyWithTokens(const QString &key, QList<const char*> tokens)
 
 uint Account::credentialsId()
 {
-    QString key = ACCOUNTS_KEY_CREDENTIALS_ID;
-    QVariant val(QVariant::Int);
-
-    if (value(key, val) != NONE)
-        return val.toUInt();
-
-    uint id = 0;
-    Service service = selectedService();
-    if (service.isValid()) {
-        selectService();
-        if (value(key, val) != NONE)
-            id = val.toUInt();
-        selectService(service);
-    }
+    Manager::Private::Measurement measurement(d->m_manager,
+                                              Statistics::ReadValue);
+    /* The value of the selected service, either from the account or from
+     * the service template, wins over the global value; the latter is
+     * looked up outside of the current group. */
+    QByteArray key = ACCOUNTS_KEY_CREDENTIALS_ID.toLatin1();
+    QByteArray fullKey = d->prefixLatin1 + key;
+    GVariant *variant = ag_account_get_variant(d->m_account,
+                                               fullKey.constData(), NULL);
+    bool ok = false;
+    uint id = variant != 0 ? gVariantToQVariant(variant).toUInt(&ok) : 0;
+    if (ok) return id;
+
+    AgService *selected = ag_account_get_selected_service(d->m_account);
+    if (selected == 0) return 0;
+
+    ag_account_select_service(d->m_account, NULL);
+    variant = ag_account_get_variant(d->m_account, key.constData(), NULL);
+    id = variant != 0 ? gVariantToQVariant(variant).toUInt() : 0;
+    ag_account_select_service(d->m_account, selected);
     return id;
 }
 
@@ -955,3 +2033,20 @@ AgAccount *Account::account()
 {
     return d->m_account;
 }
+
+/* Used by AccountService to record its changes */
+void Account::recordChange(AgService *service, const char *key)
+{
+    d->recordChange(service, key);
+}
+
+/* Used by the Manager to decide whether the account can be dropped from its
+ * cache: watches, unsaved changes and store operations must not be lost */
+bool Account::isInUse() const
+{
+    /* This covers the Watch objects as well as the callbacks installed
+     * with addWatch() */
+    return !d->m_watchServices.isEmpty() ||
+        d->m_storesInFlight > 0 || d->m_syncQueued ||
+        hasPendingChanges();
+}
@@ -32,16 +32,19 @@
 #include "Accounts/accountscommon.h"
 #include "Accounts/error.h"
 #include "Accounts/service.h"
+#include "Accounts/setting-key.h"
 
 #define ACCOUNTS_KEY_CREDENTIALS_ID QStringLiteral("CredentialsId")
+#include <QMap>
 #include <QObject>
 #include <QStringList>
 #include <QVariant>
 
+#include <functional>
+
 extern "C"
 {
     typedef struct _AgAccount AgAccount;
-    typedef struct _AgAccountWatch *AgAccountWatch;
 }
 
 /*!
@@ -67,6 +70,11 @@ enum SettingSource
     TEMPLATE
 };
 
+// Don't include in docs: \cond
+/* Prevents the deduction of a template parameter from a function argument */
+template <typename T> struct NonDeduced { typedef T Type; };
+// \endcond
+
 class ACCOUNTS_EXPORT Watch: public QObject
 {
     Q_OBJECT
@@ -78,17 +86,18 @@ public:
     Watch(QObject *parent = 0);
     ~Watch();
 
-    void setWatch(AgAccountWatch w) { watch = w; };
     class Private;
     // \endcond
 
 Q_SIGNALS:
     void notify(const char *key);
+    void changed(const QVariantMap &values);
 
     // \cond
 private:
-    AgAccountWatch watch;
+    Private *d;
     friend class Private;
+    friend class Account;
     // \endcond
 };
 
@@ -155,11 +164,17 @@ public:
     QString group() const;
     bool isWritable() const;
     void remove(const QString &key);
+    void remove(const SettingKey &key);
 
     void setValue(const QString &key, const QVariant &value);
+    void setValue(const SettingKey &key, const QVariant &value);
+    void setValues(const QVariantMap &values);
     QVariant value(const QString &key,
                    const QVariant &defaultValue = QVariant(),
                    SettingSource *source = 0) const;
+    QVariant value(const SettingKey &key,
+                   const QVariant &defaultValue = QVariant(),
+                   SettingSource *source = 0) const;
     SettingSource value(const QString &key, QVariant &value) const;
     QString valueAsString(const QString &key,
                           QString default_value = QString::null,
@@ -173,11 +188,42 @@ public:
     bool valueAsBool(const QString &key,
                      bool default_value = false,
                      SettingSource *source = 0) const;
+    QVariantMap values(const QStringList &keys) const;
+    QVariant valueWithFallback(const QString &key,
+                               const Service &service = Service(),
+                               const QVariant &defaultValue = QVariant(),
+                               SettingSource *source = 0) const;
+    QVariant valueWithFallback(const SettingKey &key,
+                               const Service &service = Service(),
+                               const QVariant &defaultValue = QVariant(),
+                               SettingSource *source = 0) const;
+
+    template <typename T>
+    T value(const QString &key,
+            const typename NonDeduced<T>::Type &defaultValue = T(),
+            SettingSource *source = 0) const;
+    template <typename T>
+    T value(const SettingKey &key,
+            const typename NonDeduced<T>::Type &defaultValue = T(),
+            SettingSource *source = 0) const;
 
     Watch *watchKey(const QString &key = QString());
+    Watch *watchKey(const SettingKey &key);
+    Watch *watchKey(const QString &key, int batchInterval);
+    Watch *watchKey(const SettingKey &key, int batchInterval);
+    quint32 addWatch(const QString &key,
+                     const std::function<void(const QStringList &keys)>
+                     &callback);
+    void removeWatch(quint32 id);
 
     void sync();
     bool syncAndBlock();
+    bool syncAndBlock(int timeout, Error *error = 0);
+    void cancelSync();
+
+    bool hasPendingChanges() const;
+    QMap<QString,QStringList> pendingChanges() const;
+    void discardChanges();
 
     void remove();
 
@@ -196,9 +242,13 @@ Q_SIGNALS:
 
 private:
     AgAccount *account();
+    void recordChange(AgService *service, const char *key);
+    bool isInUse() const;
     // Don't include private data in docs: \cond
     class Private;
     Account(Private *d, QObject *parent = 0);
+    static Account *load(Manager *manager, AccountId id, QObject *parent,
+                         Error *error);
     friend class Manager;
     friend class Account::Private;
     friend class Watch;
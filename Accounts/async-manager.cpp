@@ -0,0 +1,316 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "async-manager.h"
+#include "account.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QEvent>
+#include <QThread>
+
+namespace Accounts
+{
+
+/*!
+ * @class AsyncManager
+ * @headerfile async-manager.h Accounts/AsyncManager
+ *
+ * @brief Runs account operations on a dedicated thread.
+ *
+ * @details The AsyncManager owns a Manager living in a separate thread,
+ * and offers QFuture-based variants of the most common operations. Since the
+ * database operations happen in that thread, waiting for a locked database
+ * will never block the thread the AsyncManager was created in.
+ *
+ * The operations are executed one at a time, in the order in which they are
+ * requested. The Manager is created (in the worker thread) when the first
+ * operation is executed; this is also where libaccounts-glib will deliver
+ * its notifications. For this to work, Qt must be using the GLib event
+ * dispatcher, which gives each thread its own GMainContext.
+ *
+ * Example code:
+ * @code
+ * Accounts::AsyncManager *manager = new Accounts::AsyncManager(this);
+ * QFutureWatcher<Accounts::AccountIdList> *watcher =
+ *     new QFutureWatcher<Accounts::AccountIdList>(this);
+ * connect(watcher, SIGNAL(finished()), this, SLOT(onAccountsListed()));
+ * watcher->setFuture(manager->accountList());
+ * @endcode
+ */
+
+class AsyncManagerPrivate
+{
+    Q_DECLARE_PUBLIC(AsyncManager)
+
+public:
+    AsyncManagerPrivate(AsyncManager *q,
+                        const std::function<Manager *()> &factory);
+    ~AsyncManagerPrivate();
+
+private:
+    class Worker;
+    class JobEvent;
+
+    QThread m_thread;
+    Worker *m_worker;
+    mutable AsyncManager *q_ptr;
+};
+
+class AsyncManagerPrivate::JobEvent: public QEvent
+{
+public:
+    /* A JobEvent with no job stops the worker */
+    JobEvent(const std::function<void(Manager *)> &job):
+        QEvent(eventType()),
+        m_job(job)
+    {
+    }
+
+    static QEvent::Type eventType() {
+        static int type = QEvent::registerEventType();
+        return QEvent::Type(type);
+    }
+
+    std::function<void(Manager *)> m_job;
+};
+
+class AsyncManagerPrivate::Worker: public QObject
+{
+public:
+    Worker(const std::function<Manager *()> &factory):
+        QObject(0),
+        m_manager(0),
+        m_factory(factory)
+    {
+    }
+
+    bool event(QEvent *e) Q_DECL_OVERRIDE;
+
+private:
+    Manager *m_manager;
+    std::function<Manager *()> m_factory;
+};
+
+} // namespace
+
+using namespace Accounts;
+
+bool AsyncManagerPrivate::Worker::event(QEvent *e)
+{
+    if (e->type() != JobEvent::eventType()) {
+        return QObject::event(e);
+    }
+
+    JobEvent *jobEvent = static_cast<JobEvent *>(e);
+    if (!jobEvent->m_job) {
+        delete m_manager;
+        m_manager = 0;
+        thread()->quit();
+        return true;
+    }
+
+    if (m_manager == 0) {
+        QAbstractEventDispatcher *dispatcher =
+            QAbstractEventDispatcher::instance();
+        if (Q_UNLIKELY(!dispatcher->inherits("QEventDispatcherGlib"))) {
+            qWarning() << "AsyncManager: not using the GLib event dispatcher;"
+                " account notifications will not be delivered";
+        }
+        m_manager = m_factory();
+    }
+    jobEvent->m_job(m_manager);
+    return true;
+}
+
+AsyncManagerPrivate::AsyncManagerPrivate(AsyncManager *q,
+                                         const std::function<Manager *()>
+                                         &factory):
+    m_worker(new Worker(factory)),
+    q_ptr(q)
+{
+    m_thread.setObjectName(ASCII("AccountsWorker"));
+    m_worker->moveToThread(&m_thread);
+    m_thread.start();
+}
+
+AsyncManagerPrivate::~AsyncManagerPrivate()
+{
+    /* Let the worker complete all the pending jobs, then destroy the
+     * manager in its own thread */
+    QCoreApplication::postEvent(m_worker,
+                                new JobEvent(std::function<void(Manager *)>()));
+    m_thread.wait();
+    delete m_worker;
+    m_worker = 0;
+}
+
+/*!
+ * Constructor. The worker thread will use a Manager created with the
+ * Manager(QObject *parent) constructor.
+ */
+AsyncManager::AsyncManager(QObject *parent):
+    QObject(parent),
+    d_ptr(new AsyncManagerPrivate(this, []() {
+        return new Manager();
+    }))
+{
+}
+
+/*!
+ * Constructor. The worker thread will use a Manager created for the given
+ * service type.
+ * @param serviceType The service type.
+ * @param parent The parent object.
+ */
+AsyncManager::AsyncManager(const QString &serviceType, QObject *parent):
+    QObject(parent),
+    d_ptr(new AsyncManagerPrivate(this, [serviceType]() {
+        return new Manager(serviceType);
+    }))
+{
+}
+
+/*!
+ * Constructor. The worker thread will use a Manager created with the given
+ * options.
+ * @param options Options for the Manager.
+ * @param parent The parent object.
+ */
+AsyncManager::AsyncManager(Manager::Options options, QObject *parent):
+    QObject(parent),
+    d_ptr(new AsyncManagerPrivate(this, [options]() {
+        return new Manager(options);
+    }))
+{
+}
+
+/*!
+ * Destructor. It waits until all the pending operations have completed.
+ */
+AsyncManager::~AsyncManager()
+{
+    delete d_ptr;
+    d_ptr = 0;
+}
+
+void AsyncManager::post(const std::function<void(Manager *)> &job)
+{
+    Q_D(AsyncManager);
+    QCoreApplication::postEvent(d->m_worker,
+                                new AsyncManagerPrivate::JobEvent(job));
+}
+
+/*!
+ * Asynchronous version of Manager::accountList().
+ */
+QFuture<AccountIdList> AsyncManager::accountList(const QString &serviceType)
+{
+    return run<AccountIdList>([serviceType](Manager *manager) {
+        return manager->accountList(serviceType);
+    });
+}
+
+/*!
+ * Asynchronous version of Manager::accountListEnabled().
+ */
+QFuture<AccountIdList>
+AsyncManager::accountListEnabled(const QString &serviceType)
+{
+    return run<AccountIdList>([serviceType](Manager *manager) {
+        return manager->accountListEnabled(serviceType);
+    });
+}
+
+/*!
+ * Loads the settings of an account.
+ * @param id The account ID.
+ * @param serviceName The service whose settings must be loaded; if empty,
+ * the global account settings are loaded.
+ *
+ * @return A future holding all the settings, or an empty map if the account
+ * could not be loaded or the service does not exist.
+ */
+QFuture<QVariantMap> AsyncManager::accountSettings(AccountId id,
+                                                   const QString &serviceName)
+{
+    return run<QVariantMap>([id, serviceName](Manager *manager) {
+        QVariantMap settings;
+        Service service;
+        if (!serviceName.isEmpty()) {
+            /* Selecting an invalid service selects the global settings */
+            service = manager->service(serviceName);
+            if (!service.isValid()) return settings;
+        }
+
+        Account *account = Account::fromId(manager, id);
+        if (account == 0) return settings;
+
+        if (service.isValid()) account->selectService(service);
+        Q_FOREACH (const QString &key, account->allKeys()) {
+            settings.insert(key, account->value(key));
+        }
+        delete account;
+        return settings;
+    });
+}
+
+/*!
+ * Changes some settings of an account, and stores them.
+ * @param id The account ID.
+ * @param serviceName The service whose settings must be changed; if empty,
+ * the global account settings are changed.
+ * @param settings The new settings; keys associated with an invalid
+ * QVariant are removed.
+ *
+ * @return A future holding the result of Account::syncAndBlock(), or false
+ * if the account could not be loaded or the service does not exist.
+ */
+QFuture<bool> AsyncManager::storeSettings(AccountId id,
+                                          const QString &serviceName,
+                                          const QVariantMap &settings)
+{
+    return run<bool>([id, serviceName, settings](Manager *manager) {
+        Service service;
+        if (!serviceName.isEmpty()) {
+            service = manager->service(serviceName);
+            if (!service.isValid()) return false;
+        }
+
+        Account *account = Account::fromId(manager, id);
+        if (account == 0) return false;
+
+        if (service.isValid()) account->selectService(service);
+        QVariantMap::const_iterator i;
+        for (i = settings.constBegin(); i != settings.constEnd(); i++) {
+            if (i.value().isValid()) {
+                account->setValue(i.key(), i.value());
+            } else {
+                account->remove(i.key());
+            }
+        }
+        bool ok = account->syncAndBlock();
+        delete account;
+        return ok;
+    });
+}
@@ -0,0 +1,98 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTS_ASYNC_MANAGER_H
+#define ACCOUNTS_ASYNC_MANAGER_H
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QObject>
+#include <QString>
+#include <QVariantMap>
+
+#include <functional>
+
+#include "Accounts/accountscommon.h"
+#include "Accounts/manager.h"
+
+namespace Accounts
+{
+
+class AsyncManagerPrivate;
+class ACCOUNTS_EXPORT AsyncManager: public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AsyncManager(QObject *parent = 0);
+    explicit AsyncManager(const QString &serviceType, QObject *parent = 0);
+    explicit AsyncManager(Manager::Options options, QObject *parent = 0);
+    virtual ~AsyncManager();
+
+    QFuture<AccountIdList> accountList(const QString &serviceType = QString());
+    QFuture<AccountIdList>
+        accountListEnabled(const QString &serviceType = QString());
+
+    QFuture<QVariantMap> accountSettings(AccountId id,
+                                         const QString &serviceName = QString());
+    QFuture<bool> storeSettings(AccountId id,
+                                const QString &serviceName,
+                                const QVariantMap &settings);
+
+    template <typename T>
+    QFuture<T> run(const std::function<T(Manager *)> &function);
+
+private:
+    // Don't include private data in docs: \cond
+    void post(const std::function<void(Manager *)> &job);
+
+    AsyncManagerPrivate *d_ptr;
+    Q_DECLARE_PRIVATE(AsyncManager)
+    // \endcond
+};
+
+/*!
+ * Runs a function on the worker thread.
+ * @param function The function to be executed; it receives the Manager
+ * living in the worker thread, which must not be used outside of the
+ * function.
+ *
+ * @return A future which will hold the value returned by \a function.
+ */
+template <typename T>
+QFuture<T> AsyncManager::run(const std::function<T(Manager *)> &function)
+{
+    QFutureInterface<T> promise;
+    promise.reportStarted();
+    QFuture<T> future = promise.future();
+    post([promise, function](Manager *manager) mutable {
+        T result = function(manager);
+        promise.reportResult(result);
+        promise.reportFinished();
+    });
+    return future;
+}
+
+} //namespace Accounts
+
+#endif // ACCOUNTS_ASYNC_MANAGER_H
@@ -54,6 +54,7 @@ public:
                                       account which has been deleted */
         DatabaseLocked,             /**< The database is locked */
         AccountNotFound,            /**< The account couldn't be found */
+        Cancelled,                  /**< The operation has been cancelled */
     };
 
     /*!
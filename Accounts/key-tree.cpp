@@ -0,0 +1,97 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "key-tree.h"
+
+using namespace Accounts;
+
+static GQuark generationQuark()
+{
+    static GQuark quark = 0;
+    if (Q_UNLIKELY(quark == 0)) {
+        quark = g_quark_from_static_string("accounts-qt-settings-generation");
+    }
+    return quark;
+}
+
+uint KeyTree::generation(AgAccount *account)
+{
+    return GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(account),
+                                               generationQuark()));
+}
+
+void KeyTree::touch(AgAccount *account)
+{
+    if (account == 0) return;
+    g_object_set_qdata(G_OBJECT(account), generationQuark(),
+                       GUINT_TO_POINTER(generation(account) + 1));
+}
+
+void KeyTree::build(AgAccount *account, AgAccountSettingIter *iter)
+{
+    m_groups.clear();
+    m_generation = generation(account);
+    m_isValid = true;
+
+    const gchar *key;
+    GVariant *val;
+    while (ag_account_settings_iter_get_next(iter, &key, &val))
+    {
+        const QStringList parts =
+            QString::fromLatin1(key).split(QLatin1Char('/'));
+        QString path;
+        for (int i = 0; i < parts.count() - 1; i++) {
+            Group &group = m_groups[path];
+            const QString &name = parts.at(i);
+            if (!group.groupSet.contains(name)) {
+                group.groupSet.insert(name);
+                group.groups.append(name);
+            }
+            path += name + QLatin1Char('/');
+        }
+
+        Group &group = m_groups[path];
+        const QString &name = parts.last();
+        if (!group.keySet.contains(name)) {
+            group.keySet.insert(name);
+            group.keys.append(name);
+        }
+    }
+}
+
+QStringList KeyTree::childGroups(const QString &prefix) const
+{
+    return m_groups.value(prefix).groups;
+}
+
+QStringList KeyTree::childKeys(const QString &prefix) const
+{
+    return m_groups.value(prefix).keys;
+}
+
+bool KeyTree::containsKey(const QString &prefix, const QString &key) const
+{
+    QHash<QString,Group>::const_iterator i = m_groups.constFind(prefix);
+    return i != m_groups.constEnd() && i->keySet.contains(key);
+}
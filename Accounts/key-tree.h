@@ -0,0 +1,80 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTS_KEY_TREE_H
+#define ACCOUNTS_KEY_TREE_H
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+#undef signals
+#include <libaccounts-glib/ag-account.h>
+
+namespace Accounts {
+
+/* Index of the setting keys of an account service, built from a settings
+ * iterator; it answers the QSettings-like queries on a group without
+ * walking all the settings.
+ *
+ * Since several Qt objects can modify the settings of the same AgAccount,
+ * the tree is considered outdated as soon as the generation counter of the
+ * AgAccount changes: all the code modifying the settings (or being notified
+ * of their change) must call touch(). */
+class KeyTree
+{
+public:
+    KeyTree(): m_isValid(false), m_generation(0) {}
+
+    static void touch(AgAccount *account);
+
+    bool isValid(AgAccount *account) const {
+        return m_isValid && m_generation == generation(account);
+    }
+    void build(AgAccount *account, AgAccountSettingIter *iter);
+
+    QStringList childGroups(const QString &prefix) const;
+    QStringList childKeys(const QString &prefix) const;
+    bool containsKey(const QString &prefix, const QString &key) const;
+
+private:
+    static uint generation(AgAccount *account);
+
+    /* The entries of a group, in the order they were found */
+    struct Group {
+        QStringList groups;
+        QStringList keys;
+        QSet<QString> groupSet;
+        QSet<QString> keySet;
+    };
+
+    bool m_isValid;
+    uint m_generation;
+    /* Indexed by the full path of the group, including the trailing slash;
+     * the root group is the empty string */
+    QHash<QString,Group> m_groups;
+};
+
+} // namespace
+
+#endif // ACCOUNTS_KEY_TREE_H
@@ -26,8 +26,18 @@
 #include "service.h"
 #include "manager.h"
 #include "manager_p.h"
-
+#include "utils.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QMetaMethod>
+#include <QMutex>
+#include <QStandardPaths>
+#include <QThread>
+#include <QTimer>
 #include <libaccounts-glib/ag-account.h>
+#include <libaccounts-glib/ag-service.h>
 
 
 namespace Accounts {
@@ -40,6 +50,10 @@ namespace Accounts {
  *
  * @details The Manager offers ways to create accounts, list accounts, services
  * and providers. It also emits signals when accounts are created and removed.
+ *
+ * Services, providers and applications are read from the system only once:
+ * the Manager keeps them in memory, and refreshes them when the contents of
+ * the directories holding their definition files change.
  */
 
 /*!
@@ -72,6 +86,48 @@ namespace Accounts {
  * @param id Identifier of the Account
  */
 
+/*!
+ * @fn Manager::accountsUpdated(const Accounts::AccountIdList &ids)
+ *
+ * The signal is emitted instead of accountUpdated() when notification
+ * coalescing is enabled; see setCoalescingInterval().
+ *
+ * @param ids Identifiers of the accounts which have been updated, without
+ * duplicates.
+ */
+
+/*!
+ * @fn Manager::enabledEvents(const Accounts::AccountIdList &ids)
+ *
+ * The signal is emitted instead of enabledEvent() when notification
+ * coalescing is enabled; see setCoalescingInterval().
+ *
+ * @param ids Identifiers of the accounts, without duplicates.
+ */
+
+/*!
+ * @fn Manager::accountsSynced(quint32 batchId, Accounts::Error error)
+ *
+ * The signal is emitted when all the store operations started by a call to
+ * syncAccounts() have completed.
+ *
+ * @param batchId The identifier returned by syncAccounts().
+ * @param error The first error which occurred, if any.
+ */
+
+/*!
+ * @fn Manager::keyChanged(Accounts::AccountId id, const QString &serviceName, const QString &key, const QVariant &value)
+ *
+ * The signal is emitted when an account is stored with a key watched with
+ * watchKey(); the value might be the same as before.
+ *
+ * @param id The account ID.
+ * @param serviceName The name of the service whose setting has changed.
+ * @param key The name of the key.
+ * @param value The new value of the key; this is an invalid QVariant if
+ * the key has been removed and the service defines no default for it.
+ */
+
 /*!
  * @fn Manager::enabledEvent(Accounts::AccountId id)
  *
@@ -88,18 +144,197 @@ namespace Accounts {
  * @param id identifier of the Account
  */
 
+/* Backends of the managers created with the ShareBackend option, indexed
+ * by the thread and the parameters they were created with */
+struct BackendKey {
+    QThread *thread;
+    QString serviceType;
+    bool useDBus;
+
+    bool operator==(const BackendKey &other) const {
+        return thread == other.thread && serviceType == other.serviceType &&
+            useDBus == other.useDBus;
+    }
+};
+
+static uint qHash(const BackendKey &key, uint seed = 0)
+{
+    return ::qHash(key.thread, seed) ^ ::qHash(key.serviceType, seed) ^
+        uint(key.useDBus);
+}
+
+typedef QHash<BackendKey,AgManager*> BackendHash;
+Q_GLOBAL_STATIC(BackendHash, sharedBackends)
+Q_GLOBAL_STATIC(QMutex, sharedBackendsMutex)
+
+/* Tracks the store operations started by Manager::syncAccounts() */
+class SyncBatch: public QObject
+{
+public:
+    SyncBatch(Manager *manager, quint32 id):
+        QObject(manager),
+        m_manager(manager),
+        m_id(id),
+        m_isStarted(false)
+    {
+    }
+
+    void start(const QList<Account *> &accounts);
+
+private:
+    void onCompleted(Account *account, const Error &error);
+    void finish();
+
+    Manager *m_manager;
+    quint32 m_id;
+    bool m_isStarted;
+    QSet<Account *> m_pending;
+    Error m_error;
+};
+
+void SyncBatch::start(const QList<Account *> &accounts)
+{
+    Q_FOREACH (Account *account, accounts) {
+        if (account == 0 || m_pending.contains(account)) continue;
+        m_pending.insert(account);
+        QObject::connect(account, &Account::synced,
+                         this, [this, account]() {
+            onCompleted(account, Error());
+        });
+        QObject::connect(account, &Account::error,
+                         this, [this, account](Error error) {
+            onCompleted(account, error);
+        });
+        QObject::connect(account, &QObject::destroyed,
+                         this, [this, account]() {
+            onCompleted(account, Error(Error::Unknown,
+                                       ASCII("Account destroyed")));
+        });
+    }
+
+    /* Take a copy, since the set shrinks as the operations complete */
+    const QSet<Account *> pending = m_pending;
+    Q_FOREACH (Account *account, pending) {
+        if (m_pending.contains(account)) account->sync();
+    }
+
+    m_isStarted = true;
+    if (m_pending.isEmpty()) finish();
+}
+
+void SyncBatch::onCompleted(Account *account, const Error &error)
+{
+    if (!m_pending.remove(account)) return;
+    QObject::disconnect(account, 0, this, 0);
+
+    if (error.type() != Error::NoError && m_error.type() == Error::NoError) {
+        m_error = error;
+    }
+    if (m_isStarted && m_pending.isEmpty()) finish();
+}
+
+void SyncBatch::finish()
+{
+    /* Always report the completion from the event loop, so that the client
+     * already knows the batch ID */
+    QTimer *timer = new QTimer(this);
+    timer->setSingleShot(true);
+    QObject::connect(timer, &QTimer::timeout, this, [this]() {
+        Q_EMIT m_manager->accountsSynced(m_id, m_error);
+        deleteLater();
+    });
+    timer->start(0);
+}
+
+static void onSharedBackendFinalized(gpointer data, GObject *)
+{
+    BackendKey *key = static_cast<BackendKey*>(data);
+    {
+        QMutexLocker locker(sharedBackendsMutex());
+        sharedBackends()->remove(*key);
+    }
+    delete key;
+}
+
 } //namespace Accounts
 
 using namespace Accounts;
 
+AgManager *Manager::Private::newBackend(const QString &serviceType,
+                                        Options options, GError **error)
+{
+    QByteArray type = serviceType.toUtf8();
+    return (AgManager *)g_initable_new(AG_TYPE_MANAGER, NULL, error,
+        "use-dbus", !options.testFlag(DisableNotifications),
+        "service-type", type.isEmpty() ? NULL : type.constData(),
+        NULL);
+}
+
+/* The AgManager is shared among the managers living in the same thread:
+ * GLib signals are delivered in the thread owning the main context where
+ * they were connected, and libaccounts-glib is not thread safe. */
+AgManager *Manager::Private::sharedBackend(const QString &serviceType,
+                                           Options options, GError **error)
+{
+    BackendKey key;
+    key.thread = QThread::currentThread();
+    key.serviceType = serviceType;
+    key.useDBus = !options.testFlag(DisableNotifications);
+
+    QMutexLocker locker(sharedBackendsMutex());
+    AgManager *manager = sharedBackends()->value(key, 0);
+    if (manager != 0) return (AgManager *)g_object_ref(manager);
+
+    manager = newBackend(serviceType, options, error);
+    if (manager != 0) {
+        sharedBackends()->insert(key, manager);
+        g_object_weak_ref(G_OBJECT(manager), onSharedBackendFinalized,
+                          new BackendKey(key));
+    }
+    return manager;
+}
+
+void Manager::Private::create(Manager *q, const QString &serviceType,
+                              Options options)
+{
+    q_ptr = q;
+    m_options = options;
+    m_serviceType = serviceType;
+
+    if (options.testFlag(LazyInitialization)) {
+        m_initializationPending = true;
+    } else {
+        initialize();
+    }
+}
+
+void Manager::Private::initialize()
+{
+    m_initializationPending = false;
+
+    GError *error = NULL;
+    AgManager *manager = m_options.testFlag(ShareBackend) ?
+        sharedBackend(m_serviceType, m_options, &error) :
+        newBackend(m_serviceType, m_options, &error);
+    if (Q_LIKELY(manager)) {
+        init(q_ptr, manager);
+    } else {
+        qWarning() << "Manager could not be created." << error->message;
+        lastError = Error(error);
+        g_error_free(error);
+    }
+}
+
 void Manager::Private::init(Manager *q, AgManager *manager)
 {
-    Q_ASSERT(q_ptr == 0);
+    Q_ASSERT(q_ptr == 0 || q_ptr == q);
     Q_ASSERT(m_manager == 0);
 
     q_ptr = q;
     m_manager = manager;
 
+    qRegisterMetaType<AccountIdList>("Accounts::AccountIdList");
+
     if (manager) {
         g_signal_connect_swapped
             (manager, "account-created",
@@ -118,24 +353,437 @@ void Manager::Private::init(Manager *q, AgManager *manager)
     }
 }
 
+/* Returns the list of account IDs, to be freed with ag_manager_list_free() */
+GList *Manager::Private::listAccounts(const QString &serviceType,
+                                      bool enabledOnly)
+{
+    Measurement measurement(q_ptr, Statistics::ListAccounts);
+    AgManager *manager = backend();
+    if (serviceType.isEmpty()) {
+        return enabledOnly ?
+            ag_manager_list_enabled(manager) : ag_manager_list(manager);
+    }
+
+    QByteArray type = serviceType.toUtf8();
+    return enabledOnly ?
+        ag_manager_list_enabled_by_service_type(manager, type.constData()) :
+        ag_manager_list_by_service_type(manager, type.constData());
+}
+
+/* Visits the accounts in the list, and frees it */
+int Manager::Private::forEachAccount(GList *list,
+                                     const std::function<bool(Account *)>
+                                     &callback)
+{
+    int count = 0;
+    for (GList *iter = list; iter; iter = g_list_next(iter))
+    {
+        AccountId id = (AccountId)GPOINTER_TO_INT(iter->data);
+
+        /* Use the shared object, if it's already loaded; otherwise, load a
+         * temporary one */
+        Account *account = m_accounts.value(id).account;
+        bool isTemporary = false;
+        if (account == 0) {
+            Error error;
+            account = Account::load(q_ptr, id, 0, &error);
+            if (account == 0) continue;
+            isTemporary = true;
+        }
+
+        count++;
+        bool goOn = callback(account);
+        if (isTemporary) delete account;
+        if (!goOn) break;
+    }
+
+    ag_manager_list_free(list);
+    return count;
+}
+
+/* Accounts having watches installed, or changes which are not stored yet,
+ * are still in use, even if they haven't been requested for a long time */
+bool Manager::Private::isAccountInUse(Account *account)
+{
+    return account->isInUse();
+}
+
+Account *Manager::Private::cachedAccount(AccountId id)
+{
+    QHash<AccountId,CachedAccount>::iterator i = m_accounts.find(id);
+    if (i == m_accounts.end()) {
+        record(Statistics::CacheMiss);
+        return 0;
+    }
+
+    m_accountsByUse.remove(i->lastUse);
+    if (i->account.isNull()) {
+        /* The client deleted the object */
+        m_accounts.erase(i);
+        record(Statistics::CacheMiss);
+        return 0;
+    }
+
+    record(Statistics::CacheHit);
+    i->lastUse = ++m_accountsUseCounter;
+    m_accountsByUse.insert(i->lastUse, id);
+    return i->account;
+}
+
+void Manager::Private::cacheAccount(AccountId id, Account *account)
+{
+    uncacheAccount(id);
+
+    CachedAccount entry;
+    entry.account = account;
+    entry.lastUse = ++m_accountsUseCounter;
+    m_accounts.insert(id, entry);
+    m_accountsByUse.insert(entry.lastUse, id);
+}
+
+void Manager::Private::uncacheAccount(AccountId id)
+{
+    QHash<AccountId,CachedAccount>::iterator i = m_accounts.find(id);
+    if (i == m_accounts.end()) return;
+
+    m_accountsByUse.remove(i->lastUse);
+    m_accounts.erase(i);
+}
+
+void Manager::Private::trimAccountCache(quint64 firstKeptUse)
+{
+    if (m_accountCacheLimit <= 0) return;
+
+    QMap<quint64,AccountId>::iterator i = m_accountsByUse.begin();
+    while (m_accounts.count() > m_accountCacheLimit &&
+           i != m_accountsByUse.end() && i.key() < firstKeptUse) {
+        AccountId id = i.value();
+        Account *account = m_accounts.value(id).account;
+        if (account != 0 && isAccountInUse(account)) {
+            ++i;
+            continue;
+        }
+
+        i = m_accountsByUse.erase(i);
+        m_accounts.remove(id);
+        if (account != 0) {
+            /* Do not destroy the object right away: the caller might still
+             * be using it */
+            account->deleteLater();
+        }
+    }
+}
+
+Manager::Private::Catalog &Manager::Private::catalog()
+{
+    if (m_catalog.isValid) return m_catalog;
+
+    GList *list = ag_manager_list_services(backend());
+    for (GList *iter = list; iter; iter = g_list_next(iter))
+    {
+        Service service((AgService*)iter->data, StealReference);
+        m_catalog.services.append(service);
+        m_catalog.servicesByName.insert(service.name(), service);
+        m_catalog.servicesByType[service.serviceType()].append(service);
+        m_catalog.servicesByProvider[service.provider()].append(service);
+        Q_FOREACH (const QString &tag, service.tags()) {
+            m_catalog.servicesByTag[tag].append(service);
+        }
+    }
+    g_list_free(list);
+
+    list = ag_manager_list_providers(backend());
+    for (GList *iter = list; iter; iter = g_list_next(iter))
+    {
+        Provider provider((AgProvider*)iter->data, StealReference);
+        m_catalog.providers.append(provider);
+        m_catalog.providersByName.insert(provider.name(), provider);
+    }
+    g_list_free(list);
+
+    m_catalog.isValid = true;
+    watchCatalogDirectories();
+    return m_catalog;
+}
+
+void Manager::Private::invalidateCatalog()
+{
+    m_catalog = Catalog();
+    m_catalogGeneration++;
+}
+
+void Manager::Private::watchCatalogDirectories()
+{
+    if (m_catalogWatcher != 0) return;
+
+    /* These are the same locations where libaccounts-glib looks for its data
+     * files */
+    static const struct {
+        const char *variable;
+        const char *subdirectory;
+    } locations[] = {
+        { "AG_SERVICES", "/accounts/services" },
+        { "AG_PROVIDERS", "/accounts/providers" },
+        { "AG_APPLICATIONS", "/accounts/applications" },
+    };
+
+    const QStringList dataDirs =
+        QStandardPaths::standardLocations(QStandardPaths::GenericDataLocation);
+    for (uint i = 0; i < sizeof(locations) / sizeof(locations[0]); i++) {
+        QByteArray path = qgetenv(locations[i].variable);
+        if (!path.isEmpty()) {
+            m_catalogDirectories.append(
+                QDir::cleanPath(QString::fromLocal8Bit(path)));
+            continue;
+        }
+        Q_FOREACH (const QString &dataDir, dataDirs) {
+            m_catalogDirectories.append(
+                QDir::cleanPath(dataDir + ASCII(locations[i].subdirectory)));
+        }
+    }
+
+    m_catalogWatcher = new QFileSystemWatcher(q_ptr);
+    addCatalogWatches();
+    QObject::connect(m_catalogWatcher, &QFileSystemWatcher::directoryChanged,
+                     q_ptr, [this](const QString &path) {
+        /* The ancestors watched in place of the missing directories (such
+         * as ~/.local/share) change for unrelated reasons too: only the
+         * changes to the data directories, or their creation, affect the
+         * catalog */
+        bool created = addCatalogWatches();
+        if (created || m_catalogDirectories.contains(path)) {
+            invalidateCatalog();
+        }
+    });
+}
+
+/* Watches the data directories, or the closest existing ancestor of those
+ * which don't exist yet; returns whether some data directory has appeared
+ * since the last call */
+bool Manager::Private::addCatalogWatches()
+{
+    bool created = false;
+    QStringList watched;
+    Q_FOREACH (const QString &directory, m_catalogDirectories) {
+        QString path = directory;
+        while (!QDir(path).exists()) {
+            QString parent = QFileInfo(path).path();
+            if (parent == path) break;
+            path = parent;
+        }
+        if (!QDir(path).exists()) continue;
+
+        watched.append(path);
+        if (!m_catalogWatcher->directories().contains(path)) {
+            m_catalogWatcher->addPath(path);
+            if (path == directory) created = true;
+        }
+    }
+
+    /* Stop watching the ancestors of the directories which got created */
+    Q_FOREACH (const QString &path, m_catalogWatcher->directories()) {
+        if (!watched.contains(path)) m_catalogWatcher->removePath(path);
+    }
+    return created;
+}
+
+void Manager::Private::queueEvent(AccountIdList &queue,
+                                  QSet<AccountId> &queued,
+                                  AccountId id)
+{
+    if (!queued.contains(id)) {
+        queued.insert(id);
+        queue.append(id);
+    }
+
+    if (m_coalescingTimer == 0) {
+        m_coalescingTimer = new QTimer(q_ptr);
+        m_coalescingTimer->setSingleShot(true);
+        QObject::connect(m_coalescingTimer, &QTimer::timeout,
+                         q_ptr, [this]() { flushQueuedEvents(); });
+    }
+    /* Don't restart the timer if it's already running: this way the
+     * notifications are delayed by at most one interval */
+    if (!m_coalescingTimer->isActive()) {
+        m_coalescingTimer->start(m_coalescingInterval);
+    }
+}
+
+void Manager::Private::flushQueuedEvents()
+{
+    Q_Q(Manager);
+
+    AccountIdList updatedAccounts = m_updatedAccounts;
+    AccountIdList enabledEvents = m_enabledEvents;
+    m_updatedAccounts.clear();
+    m_updatedAccountsSet.clear();
+    m_enabledEvents.clear();
+    m_enabledEventsSet.clear();
+
+    if (!updatedAccounts.isEmpty()) {
+        Measurement measurement(q, Statistics::SignalDelivery);
+        Q_EMIT q->accountsUpdated(updatedAccounts);
+    }
+    if (!enabledEvents.isEmpty()) {
+        Measurement measurement(q, Statistics::SignalDelivery);
+        Q_EMIT q->enabledEvents(enabledEvents);
+    }
+}
+
 void Manager::Private::on_account_created(Manager *self, AgAccountId id)
 {
+    Measurement measurement(self, Statistics::SignalDelivery);
     Q_EMIT self->accountCreated(id);
 }
 
 void Manager::Private::on_account_deleted(Manager *self, AgAccountId id)
 {
+    Measurement measurement(self, Statistics::SignalDelivery);
     Q_EMIT self->accountRemoved(id);
+
+    Private *d = self->d;
+    Account *account = d->m_accounts.value(id).account;
+    d->uncacheAccount(id);
+    if (account != 0 && d->m_accountCacheLimit > 0 &&
+        !Private::isAccountInUse(account)) {
+        account->deleteLater();
+    }
 }
 
 void Manager::Private::on_account_updated(Manager *self, AgAccountId id)
 {
-    Q_EMIT self->accountUpdated(id);
+    Private *d = self->d;
+    if (d->m_coalescingInterval >= 0) {
+        d->queueEvent(d->m_updatedAccounts, d->m_updatedAccountsSet, id);
+    } else {
+        Measurement measurement(self, Statistics::SignalDelivery);
+        Q_EMIT self->accountUpdated(id);
+    }
+}
+
+/* Returns a backend emitting the "account-updated" signal for the services
+ * of the given type; the signal is only emitted by backends created for a
+ * service type. */
+AgManager *Manager::Private::watchBackend(const QString &serviceType)
+{
+    AgManager *backend = m_watchBackends.value(serviceType);
+    if (backend != 0) return backend;
+
+    GError *error = NULL;
+    backend = m_options.testFlag(ShareBackend) ?
+        sharedBackend(serviceType, m_options, &error) :
+        newBackend(serviceType, m_options, &error);
+    if (Q_UNLIKELY(backend == 0)) {
+        qWarning() << "Cannot watch keys:" << error->message;
+        g_error_free(error);
+        return 0;
+    }
+
+    /* Deleted accounts need no notification, since no state is kept about
+     * them */
+    g_signal_connect(backend, "account-created",
+                     G_CALLBACK(&Private::on_watched_account_created), q_ptr);
+    g_signal_connect(backend, "account-updated",
+                     G_CALLBACK(&Private::on_watched_account_updated), q_ptr);
+    m_watchBackends.insert(serviceType, backend);
+    return backend;
+}
+
+void Manager::Private::releaseWatchBackend(const QString &serviceType)
+{
+    AgManager *backend = m_watchBackends.take(serviceType);
+    if (backend == 0) return;
+
+    g_signal_handlers_disconnect_by_func
+        (backend, (void *)&Private::on_watched_account_created, q_ptr);
+    g_signal_handlers_disconnect_by_func
+        (backend, (void *)&Private::on_watched_account_updated, q_ptr);
+    g_object_unref(backend);
+}
+
+QVariant Manager::Private::readWatchedKey(AgManager *backend,
+                                          AgAccount *account,
+                                          const KeyWatch &watch)
+{
+    QByteArray serviceName = watch.serviceName.toUtf8();
+    AgService *service = ag_manager_get_service(backend,
+                                                serviceName.constData());
+    if (service == 0) return QVariant();
+
+    /* The account object might be shared with an Account instance */
+    AgService *selected = ag_account_get_selected_service(account);
+    ag_account_select_service(account, service);
+    GVariant *variant = ag_account_get_variant(account,
+                                               watch.key.toLatin1().constData(),
+                                               NULL);
+    QVariant value = variant != 0 ? gVariantToQVariant(variant) : QVariant();
+    ag_account_select_service(account, selected);
+    ag_service_unref(service);
+    return value;
+}
+
+void Manager::Private::notifyWatchedKeys(AgManager *backend, AgAccountId id,
+                                         bool onlyIfSet)
+{
+    QString serviceType = m_watchBackends.key(backend);
+
+    /* The account is loaded only for the time needed to read the keys */
+    AgAccount *account = ag_manager_load_account(backend, id, NULL);
+    if (account == 0) return;
+
+    QList<AccountId> changedIds;
+    QStringList changedServices;
+    QStringList changedKeys;
+    QVariantList changedValues;
+    Q_FOREACH (const KeyWatch &watch, m_keyWatches) {
+        if (watch.serviceType != serviceType) continue;
+
+        QVariant value = readWatchedKey(backend, account, watch);
+        if (onlyIfSet && !value.isValid()) continue;
+
+        changedIds.append(id);
+        changedServices.append(watch.serviceName);
+        changedKeys.append(watch.key);
+        changedValues.append(value);
+    }
+    g_object_unref(account);
+
+    if (changedIds.isEmpty()) return;
+
+    /* Emit the signals after reading all the values, since the slots might
+     * change the watches */
+    Manager *self = q_ptr;
+    Measurement measurement(self, Statistics::SignalDelivery);
+    for (int i = 0; i < changedIds.count(); i++) {
+        Q_EMIT self->keyChanged(changedIds[i], changedServices[i],
+                                changedKeys[i], changedValues[i]);
+    }
+}
+
+void Manager::Private::on_watched_account_created(AgManager *backend,
+                                                  AgAccountId id,
+                                                  Manager *self)
+{
+    /* A new account: notify only the keys which are set */
+    self->d->notifyWatchedKeys(backend, id, true);
+}
+
+void Manager::Private::on_watched_account_updated(AgManager *backend,
+                                                  AgAccountId id,
+                                                  Manager *self)
+{
+    self->d->notifyWatchedKeys(backend, id, false);
 }
 
 void Manager::Private::on_enabled_event(Manager *self, AgAccountId id)
 {
-    Q_EMIT self->enabledEvent(id);
+    Private *d = self->d;
+    if (d->m_coalescingInterval >= 0) {
+        d->queueEvent(d->m_enabledEvents, d->m_enabledEventsSet, id);
+    } else {
+        Measurement measurement(self, Statistics::SignalDelivery);
+        Q_EMIT self->enabledEvent(id);
+    }
 }
 
 /*!
@@ -190,25 +838,46 @@ Manager::Manager(const QString &serviceType, QObject *parent):
  * Constructor, allowing option flags to be specified.
  * Users should check for lastError() to check if manager construction
  * was fully succesful.
+ *
+ * If the LazyInitialization option is given, the connection to the accounts
+ * database is not opened until the manager is first used (or one of its
+ * signals is connected); initialization errors will then be reported by
+ * lastError() right after the first operation.
  */
 Manager::Manager(Options options, QObject *parent):
     QObject(parent),
     d(new Private)
 {
-    bool disableNotifications = options.testFlag(DisableNotifications);
+    d->create(this, QString(), options);
+}
 
-    GError *error = NULL;
-    AgManager *manager =
-        (AgManager *)g_initable_new(AG_TYPE_MANAGER, NULL, &error,
-                                    "use-dbus", !disableNotifications,
-                                    NULL);
-    if (Q_LIKELY(manager)) {
-        d->init(this, manager);
-    } else {
-        qWarning() << "Manager could not be created." << error->message;
-        d->lastError = Error(error);
-        g_error_free(error);
-    }
+/*!
+ * Constructs a manager initialized with service type, allowing option flags
+ * to be specified. See Manager(const QString &serviceType, QObject *parent)
+ * for the effects of the service type.
+ *
+ * If the ShareBackend option is given, managers created in the same thread
+ * with the same service type and the same value of the DisableNotifications
+ * option use a single connection to the accounts database, and a single
+ * subscription to the inter-process notifications. Settings such as
+ * setTimeout() and setAbortOnTimeout() are then shared among all of them.
+ *
+ * @attention With the ShareBackend option, the Account objects returned by
+ * these managers for the same account ID wrap a single libaccounts-glib
+ * account: the selected service and the changes which have not been stored
+ * yet are common to all of them, and a sync() on any of them stores the
+ * changes made through the others. Components which need to edit accounts
+ * independently must not share the backend.
+ *
+ * Users should check for lastError() to check if manager construction
+ * was fully succesful.
+ */
+Manager::Manager(const QString &serviceType, Options options,
+                 QObject *parent):
+    QObject(parent),
+    d(new Private)
+{
+    d->create(this, serviceType, options);
 }
 
 /*!
@@ -216,20 +885,40 @@ Manager::Manager(Options options, QObject *parent):
  */
 Manager::~Manager()
 {
-    g_signal_handlers_disconnect_by_func
-        (d->m_manager, (void *)&Private::on_enabled_event, this);
-    g_signal_handlers_disconnect_by_func
-        (d->m_manager, (void *)&Private::on_account_updated, this);
-    g_signal_handlers_disconnect_by_func
-        (d->m_manager, (void *)&Private::on_account_deleted, this);
-    g_signal_handlers_disconnect_by_func
-        (d->m_manager, (void *)&Private::on_account_created, this);
-    g_object_unref(d->m_manager);
+    if (d->m_manager != 0) {
+        g_signal_handlers_disconnect_by_func
+            (d->m_manager, (void *)&Private::on_enabled_event, this);
+        g_signal_handlers_disconnect_by_func
+            (d->m_manager, (void *)&Private::on_account_updated, this);
+        g_signal_handlers_disconnect_by_func
+            (d->m_manager, (void *)&Private::on_account_deleted, this);
+        g_signal_handlers_disconnect_by_func
+            (d->m_manager, (void *)&Private::on_account_created, this);
+        g_object_unref(d->m_manager);
+    }
+
+    Q_FOREACH (const QString &serviceType, d->m_watchBackends.keys()) {
+        d->releaseWatchBackend(serviceType);
+    }
 
     delete d;
     d = 0;
 }
 
+/*!
+ * \reimp
+ * Connecting to any of the Manager signals completes a lazy initialization,
+ * since notifications can only be received from an open database.
+ */
+void Manager::connectNotify(const QMetaMethod &signal)
+{
+    if (d->m_initializationPending &&
+        signal.enclosingMetaObject() == &Manager::staticMetaObject) {
+        d->initialize();
+    }
+    QObject::connectNotify(signal);
+}
+
 /*!
  * Loads an account from the database.
  * @param id Id of the account to be retrieved.
@@ -244,16 +933,233 @@ Manager::~Manager()
  */
 Account *Manager::account(const AccountId &id) const
 {
-    Account *account = d->m_accounts.value(id, 0);
+    Account *account = d->cachedAccount(id);
     if (account == 0) {
         /* Create a new account object */
         account = Account::fromId(const_cast<Manager*>(this), id,
                                   const_cast<Manager*>(this));
-        d->m_accounts[id] = account;
+        if (account != 0) {
+            d->cacheAccount(id, account);
+        }
     }
+    if (account != 0) d->trimAccountCache(d->m_accountsUseCounter);
     return account;
 }
 
+/*!
+ * Loads several accounts from the database.
+ * @param ids Ids of the accounts to be retrieved.
+ * @param errors If not 0, receives an entry for each account which could not
+ * be loaded, describing the reason of the failure.
+ *
+ * @return The list of the accounts which could be loaded, in the same order
+ * as they appear in \a ids. Accounts which fail to load are skipped; unlike
+ * account(), this method never changes lastError().
+ * @attention The objects returned by this method are shared with those
+ * returned by account(); the same recommendations apply.
+ */
+QList<Account *> Manager::accounts(const AccountIdList &ids,
+                                   QHash<AccountId, Error> *errors) const
+{
+    Manager *self = const_cast<Manager*>(this);
+    QList<Account *> list;
+    list.reserve(ids.count());
+
+    /* The accounts being returned must survive the trimming of the cache */
+    quint64 firstUse = d->m_accountsUseCounter + 1;
+    Q_FOREACH (AccountId id, ids) {
+        Account *account = d->cachedAccount(id);
+        if (account == 0) {
+            Error error;
+            account = Account::load(self, id, self, &error);
+            if (account == 0) {
+                if (errors != 0) errors->insert(id, error);
+                continue;
+            }
+            d->cacheAccount(id, account);
+        }
+        list.append(account);
+    }
+    d->trimAccountCache(firstUse);
+    return list;
+}
+
+/*!
+ * Reads several accounts from the database, without instantiating an
+ * Account object for each of them.
+ * @param ids Ids of the accounts to be read.
+ * @param errors If not 0, receives an entry for each account which could not
+ * be read, describing the reason of the failure.
+ *
+ * This is meant for jobs which need to read many accounts: the returned
+ * AccountData objects are a lightweight snapshot of each account, and are
+ * not updated when the account changes.
+ *
+ * @return The data of the accounts which could be read, in the same order
+ * as they appear in \a ids. Like accounts(), this method never changes
+ * lastError().
+ */
+AccountDataList Manager::accountData(const AccountIdList &ids,
+                                     QHash<AccountId, Error> *errors) const
+{
+    AccountDataList list;
+    list.reserve(ids.count());
+
+    Q_FOREACH (AccountId id, ids) {
+        /* Reuse the accounts which are already loaded, if any */
+        QHash<AccountId,Private::CachedAccount>::const_iterator i =
+            d->m_accounts.constFind(id);
+        Account *account = i != d->m_accounts.constEnd() ?
+            i->account.data() : 0;
+        if (account != 0) {
+            list.append(AccountData(account->account()));
+            continue;
+        }
+
+        Private::Measurement measurement(const_cast<Manager*>(this),
+                                         Statistics::LoadAccount);
+        GError *error = 0;
+        AgAccount *agAccount = ag_manager_load_account(d->backend(), id,
+                                                       &error);
+        if (agAccount == 0) {
+            Q_ASSERT(error != 0);
+            if (errors != 0) errors->insert(id, Error(error));
+            g_error_free(error);
+            continue;
+        }
+        list.append(AccountData(agAccount));
+        g_object_unref(agAccount);
+    }
+    return list;
+}
+
+/*!
+ * Limits the number of account objects kept in memory by account() and
+ * accounts().
+ * @param limit The maximum number of cached accounts; 0 (the default) means
+ * no limit.
+ *
+ * When the limit is exceeded, the least recently requested accounts are
+ * scheduled for deletion with QObject::deleteLater(), unless they are still
+ * in use: having some Watch installed, changes which have not been stored
+ * yet or a sync() in progress. The accounts returned by a call to
+ * account() or accounts() are never dropped by that same call. Accounts
+ * which get removed from the database are dropped as well. Clients
+ * retaining the returned objects across event loop iterations should
+ * therefore track them with a QPointer, or request them again when needed.
+ */
+void Manager::setAccountCacheLimit(int limit)
+{
+    d->m_accountCacheLimit = qMax(limit, 0);
+    d->trimAccountCache();
+}
+
+/*!
+ * @return The maximum number of cached account objects, or 0 if unlimited.
+ * @see setAccountCacheLimit()
+ */
+int Manager::accountCacheLimit() const
+{
+    return d->m_accountCacheLimit;
+}
+
+/*!
+ * Enables or disables the coalescing of account notifications.
+ * @param interval The time window, in milliseconds, during which the
+ * notifications are collected. A negative value (the default) disables
+ * coalescing; 0 collects the notifications until control returns to the
+ * event loop.
+ *
+ * When coalescing is enabled, the accountUpdated() and enabledEvent() signals
+ * are no longer emitted; instead, the accountsUpdated() and enabledEvents()
+ * signals deliver the list of the affected accounts, each listed once,
+ * at most \a interval milliseconds after the first notification.
+ */
+void Manager::setCoalescingInterval(int interval)
+{
+    bool wasEnabled = d->m_coalescingInterval >= 0;
+    d->m_coalescingInterval = qMax(interval, -1);
+    if (wasEnabled && d->m_coalescingInterval < 0) {
+        /* Deliver what we have collected so far */
+        if (d->m_coalescingTimer != 0) d->m_coalescingTimer->stop();
+        d->flushQueuedEvents();
+    }
+}
+
+/*!
+ * @return The time window used for coalescing notifications, or -1 if
+ * coalescing is disabled.
+ * @see setCoalescingInterval()
+ */
+int Manager::coalescingInterval() const
+{
+    return d->m_coalescingInterval;
+}
+
+/*!
+ * Watches a key of a service on all the accounts.
+ * @param serviceName The name of the service.
+ * @param key The full name of the key.
+ *
+ * The keyChanged() signal is emitted whenever an account storing some
+ * changes to the service is updated, including the accounts created later;
+ * for a new account, only if the key is set. The accounts are only loaded
+ * for the time needed to read the key, and no Account object is created.
+ * No previous values are kept, so the memory used by the watch doesn't
+ * depend on the number of accounts; as a consequence, the signal can also
+ * be emitted when other settings of the account have changed, and the value
+ * of the key is the same as before.
+ *
+ * Changes are only notified if the manager has not been created with the
+ * DisableNotifications option.
+ *
+ * @return Whether the watch could be installed.
+ */
+bool Manager::watchKey(const QString &serviceName, const QString &key)
+{
+    Q_FOREACH (const Private::KeyWatch &watch, d->m_keyWatches) {
+        if (watch.serviceName == serviceName && watch.key == key) return true;
+    }
+
+    Service service = this->service(serviceName);
+    if (!service.isValid()) return false;
+
+    AgManager *backend = d->watchBackend(service.serviceType());
+    if (backend == 0) return false;
+
+    Private::KeyWatch watch;
+    watch.serviceName = serviceName;
+    watch.serviceType = service.serviceType();
+    watch.key = key;
+    d->m_keyWatches.append(watch);
+    return true;
+}
+
+/*!
+ * Stops watching a key installed with watchKey().
+ * @param serviceName The name of the service.
+ * @param key The full name of the key.
+ */
+void Manager::unwatchKey(const QString &serviceName, const QString &key)
+{
+    QString serviceType;
+    for (int i = 0; i < d->m_keyWatches.count(); i++) {
+        const Private::KeyWatch &watch = d->m_keyWatches.at(i);
+        if (watch.serviceName == serviceName && watch.key == key) {
+            serviceType = watch.serviceType;
+            d->m_keyWatches.removeAt(i);
+            break;
+        }
+    }
+    if (serviceType.isEmpty()) return;
+
+    /* Release the backend if no other watch needs it */
+    Q_FOREACH (const Private::KeyWatch &watch, d->m_keyWatches) {
+        if (watch.serviceType == serviceType) return;
+    }
+    d->releaseWatchBackend(serviceType);
+}
+
 /*!
  * Lists the accounts which support the requested service.
  *
@@ -265,14 +1171,7 @@ Account *Manager::account(const AccountId &id) const
  */
 AccountIdList Manager::accountList(const QString &serviceType) const
 {
-    GList *list = NULL;
-
-    if (serviceType.isEmpty()) {
-        list = ag_manager_list(d->m_manager);
-    } else {
-        list = ag_manager_list_by_service_type(d->m_manager,
-            serviceType.toUtf8().constData());
-    }
+    GList *list = d->listAccounts(serviceType, false);
 
     /* convert glist -> AccountIdList */
     AccountIdList idList;
@@ -300,13 +1199,7 @@ AccountIdList Manager::accountList(const QString &serviceType) const
  */
 AccountIdList Manager::accountListEnabled(const QString &serviceType) const
 {
-    GList *list = NULL;
-    if (serviceType.isEmpty()) {
-        list = ag_manager_list_enabled(d->m_manager);
-    } else {
-        list = ag_manager_list_enabled_by_service_type(d->m_manager,
-            serviceType.toUtf8().constData());
-    }
+    GList *list = d->listAccounts(serviceType, true);
 
     /* convert glist -> AccountIdList */
     AccountIdList idList;
@@ -322,6 +1215,87 @@ AccountIdList Manager::accountListEnabled(const QString &serviceType) const
     return idList;
 }
 
+/*!
+ * Counts the accounts which support the requested service.
+ *
+ * @param serviceType Type of service that counted accounts must support.
+ * If not given and the manager is not constructed with service type,
+ * all accounts are counted.
+ *
+ * @return The number of accounts; this is the same as the size of the list
+ * returned by accountList(), but cheaper to compute.
+ */
+int Manager::accountCount(const QString &serviceType) const
+{
+    GList *list = d->listAccounts(serviceType, false);
+    int count = g_list_length(list);
+    ag_manager_list_free(list);
+    return count;
+}
+
+/*!
+ * Counts the enabled accounts which support the requested service that also
+ * must be enabled.
+ *
+ * @param serviceType Type of service that counted accounts must support.
+ * If not given and the manager is not constructed with service type,
+ * all enabled accounts are counted.
+ *
+ * @return The number of accounts; this is the same as the size of the list
+ * returned by accountListEnabled(), but cheaper to compute.
+ */
+int Manager::enabledAccountCount(const QString &serviceType) const
+{
+    GList *list = d->listAccounts(serviceType, true);
+    int count = g_list_length(list);
+    ag_manager_list_free(list);
+    return count;
+}
+
+/*!
+ * Visits the accounts which support the requested service, one at a time.
+ *
+ * @param serviceType Type of service that visited accounts must support.
+ * If empty and the manager is not constructed with service type, all
+ * accounts are visited.
+ * @param callback Function to be called on each account; it can return
+ * false to stop the iteration.
+ *
+ * Unlike loading the accounts returned by accountList() with account(), this
+ * method keeps at most one account in memory at any time: unless the account
+ * had already been loaded with account(), the object passed to \a callback
+ * is destroyed as soon as the callback returns, and must not be retained.
+ * Accounts which cannot be loaded are skipped.
+ *
+ * @return The number of accounts which have been visited.
+ */
+int Manager::forEachAccount(const QString &serviceType,
+                            const std::function<bool(Account *)> &callback)
+    const
+{
+    return d->forEachAccount(d->listAccounts(serviceType, false), callback);
+}
+
+/*!
+ * Visits the enabled accounts which support the requested service, one at a
+ * time.
+ *
+ * @param serviceType Type of service that visited accounts must support.
+ * If empty and the manager is not constructed with service type, all
+ * enabled accounts are visited.
+ * @param callback Function to be called on each account; it can return
+ * false to stop the iteration.
+ *
+ * @return The number of accounts which have been visited.
+ * @see forEachAccount()
+ */
+int Manager::forEachEnabledAccount(const QString &serviceType,
+                                   const std::function<bool(Account *)>
+                                   &callback) const
+{
+    return d->forEachAccount(d->listAccounts(serviceType, true), callback);
+}
+
 /*!
  * Creates a new account.
  * @param providerName Name of account provider.
@@ -333,6 +1307,31 @@ Account *Manager::createAccount(const QString &providerName)
     return new Account(this, providerName, this);
 }
 
+/*!
+ * Stores the pending changes of several accounts.
+ * @param accounts The accounts to be stored.
+ *
+ * The store operations are started right away, one after the other; the
+ * signal accountsSynced() is emitted once all of them have completed,
+ * successfully or not. The accounts' own synced() and error() signals are
+ * emitted as well, as if sync() had been called on each of them.
+ *
+ * @note The accounts are not written in a single transaction: if one of the
+ * operations fails, the others are not rolled back.
+ *
+ * @return An identifier for the operation, which will be passed to the
+ * accountsSynced() signal.
+ */
+quint32 Manager::syncAccounts(const QList<Account *> &accounts)
+{
+    quint32 batchId = ++d->m_lastSyncBatchId;
+    if (batchId == 0) batchId = ++d->m_lastSyncBatchId;
+
+    SyncBatch *batch = new SyncBatch(this, batchId);
+    batch->start(accounts);
+    return batchId;
+}
+
 /*!
  * Gets an object representing a service.
  * @param serviceName Name of service to get.
@@ -341,10 +1340,19 @@ Account *Manager::createAccount(const QString &providerName)
  */
 Service Manager::service(const QString &serviceName) const
 {
-    AgService *service =
-        ag_manager_get_service(d->m_manager,
+    Private::Catalog &catalog = d->catalog();
+    QHash<QString,Service>::const_iterator i =
+        catalog.servicesByName.constFind(serviceName);
+    if (i != catalog.servicesByName.constEnd()) return i.value();
+
+    /* Not in the catalog: this can happen if the service doesn't exist, or
+     * if it's not of the type this manager was created for */
+    AgService *agService =
+        ag_manager_get_service(d->backend(),
                                serviceName.toUtf8().constData());
-    return Service(service, StealReference);
+    Service service(agService, StealReference);
+    catalog.servicesByName.insert(serviceName, service);
+    return service;
 }
 
 /*!
@@ -359,14 +1367,15 @@ Service Manager::service(const QString &serviceName) const
  */
 ServiceList Manager::serviceList(const QString &serviceType) const
 {
-    GList *list;
+    Private::Catalog &catalog = d->catalog();
+    if (serviceType.isEmpty()) return catalog.services;
 
-    if (serviceType.isEmpty()) {
-        list = ag_manager_list_services(d->m_manager);
-    } else {
-        list = ag_manager_list_services_by_type(d->m_manager,
-            serviceType.toUtf8().constData());
-    }
+    QHash<QString,ServiceList>::const_iterator i =
+        catalog.servicesByType.constFind(serviceType);
+    if (i != catalog.servicesByType.constEnd()) return i.value();
+
+    GList *list = ag_manager_list_services_by_type(d->backend(),
+        serviceType.toUtf8().constData());
 
     /* convert glist -> ServiceList */
     ServiceList servList;
@@ -380,6 +1389,7 @@ ServiceList Manager::serviceList(const QString &serviceType) const
 
     g_list_free(list);
 
+    catalog.servicesByType.insert(serviceType, servList);
     return servList;
 }
 
@@ -392,9 +1402,14 @@ ServiceList Manager::serviceList(const QString &serviceType) const
  */
 ServiceList Manager::serviceList(const Application &application) const
 {
+    Private::Catalog &catalog = d->catalog();
+    QHash<QString,ServiceList>::const_iterator i =
+        catalog.servicesByApplication.constFind(application.name());
+    if (i != catalog.servicesByApplication.constEnd()) return i.value();
+
     GList *list;
 
-    list = ag_manager_list_services_by_application(d->m_manager,
+    list = ag_manager_list_services_by_application(d->backend(),
                                                    application.application());
 
     /* convert glist -> ServiceList */
@@ -409,9 +1424,24 @@ ServiceList Manager::serviceList(const Application &application) const
 
     g_list_free(list);
 
+    catalog.servicesByApplication.insert(application.name(), servList);
     return servList;
 }
 
+/*!
+ * Gets the list of the services having the given tag. If the manager is
+ * constructed with given service type only the services which supports the
+ * service type will be returned.
+ *
+ * @param tag The tag the services must have.
+ *
+ * @return List of Service objects.
+ */
+ServiceList Manager::serviceListByTag(const QString &tag) const
+{
+    return d->catalog().servicesByTag.value(tag);
+}
+
 /*!
  * Gets an object representing a provider.
  * @param providerName Name of provider to get.
@@ -420,11 +1450,18 @@ ServiceList Manager::serviceList(const Application &application) const
  */
 Provider Manager::provider(const QString &providerName) const
 {
-    AgProvider *provider;
-
-    provider = ag_manager_get_provider(d->m_manager,
-                                       providerName.toUtf8().constData());
-    return Provider(provider, StealReference);
+    Private::Catalog &catalog = d->catalog();
+    QHash<QString,Provider>::const_iterator i =
+        catalog.providersByName.constFind(providerName);
+    if (i != catalog.providersByName.constEnd()) return i.value();
+
+    AgProvider *agProvider;
+
+    agProvider = ag_manager_get_provider(d->backend(),
+                                         providerName.toUtf8().constData());
+    Provider provider(agProvider, StealReference);
+    catalog.providersByName.insert(providerName, provider);
+    return provider;
 }
 
 /*!
@@ -434,23 +1471,7 @@ Provider Manager::provider(const QString &providerName) const
  */
 ProviderList Manager::providerList() const
 {
-    GList *list;
-
-    list = ag_manager_list_providers(d->m_manager);
-
-    /* convert glist -> ProviderList */
-    ProviderList provList;
-    GList *iter;
-
-    for (iter = list; iter; iter = g_list_next(iter))
-    {
-        AgProvider *provider = (AgProvider*)iter->data;
-        provList.append(Provider(provider, StealReference));
-    }
-
-    g_list_free(list);
-
-    return provList;
+    return d->catalog().providers;
 }
 
 /*!
@@ -462,7 +1483,7 @@ ProviderList Manager::providerList() const
 ServiceType Manager::serviceType(const QString &name) const
 {
     AgServiceType *type;
-    type = ag_manager_load_service_type(d->m_manager,
+    type = ag_manager_load_service_type(d->backend(),
                                         name.toUtf8().constData());
     return ServiceType(type, StealReference);
 }
@@ -478,7 +1499,7 @@ Application Manager::application(const QString &applicationName) const
 {
     QByteArray ba = applicationName.toUtf8();
     AgApplication *application =
-        ag_manager_get_application(d->m_manager, ba.constData());
+        ag_manager_get_application(d->backend(), ba.constData());
     return Application(application);
 }
 
@@ -490,16 +1511,22 @@ Application Manager::application(const QString &applicationName) const
  */
 ApplicationList Manager::applicationList(const Service &service) const
 {
+    Private::Catalog &catalog = d->catalog();
+    QHash<QString,ApplicationList>::const_iterator i =
+        catalog.applicationsByService.constFind(service.name());
+    if (i != catalog.applicationsByService.constEnd()) return i.value();
+
     ApplicationList ret;
     GList *applications, *list;
 
-    applications = ag_manager_list_applications_by_service(d->m_manager,
+    applications = ag_manager_list_applications_by_service(d->backend(),
                                                            service.service());
     for (list = applications; list != NULL; list = list->next) {
         AgApplication *application = (AgApplication *)list->data;
         ret.append(Application(application));
     }
     g_list_free (applications);
+    catalog.applicationsByService.insert(service.name(), ret);
     return ret;
 }
 
@@ -510,7 +1537,8 @@ ApplicationList Manager::applicationList(const Service &service) const
  */
 QString Manager::serviceType() const
 {
-    return UTF8(ag_manager_get_service_type (d->m_manager));
+    if (d->m_initializationPending) return d->m_serviceType;
+    return UTF8(ag_manager_get_service_type (d->backend()));
 }
 
 /*!
@@ -524,7 +1552,7 @@ QString Manager::serviceType() const
  */
 void Manager::setTimeout(quint32 timeout)
 {
-    ag_manager_set_db_timeout(d->m_manager, timeout);
+    ag_manager_set_db_timeout(d->backend(), timeout);
 }
 
 /*!
@@ -533,7 +1561,7 @@ void Manager::setTimeout(quint32 timeout)
  */
 quint32 Manager::timeout()
 {
-    return ag_manager_get_db_timeout(d->m_manager);
+    return ag_manager_get_db_timeout(d->backend());
 }
 
 /*!
@@ -542,7 +1570,7 @@ quint32 Manager::timeout()
  */
 void Manager::setAbortOnTimeout(bool abort)
 {
-    ag_manager_set_abort_on_db_timeout(d->m_manager, abort);
+    ag_manager_set_abort_on_db_timeout(d->backend(), abort);
 }
 
 /*!
@@ -551,7 +1579,99 @@ void Manager::setAbortOnTimeout(bool abort)
  */
 bool Manager::abortOnTimeout() const
 {
-    return ag_manager_get_abort_on_db_timeout(d->m_manager);
+    return ag_manager_get_abort_on_db_timeout(d->backend());
+}
+
+/*!
+ * Sets how asynchronous operations failing because the database is locked
+ * are retried.
+ * @param policy The retry policy; an invalid policy (the default) disables
+ * retrying.
+ *
+ * Currently this affects Account::sync(): instead of emitting
+ * Account::error() with Error::DatabaseLocked, the store operation is
+ * rescheduled on the event loop according to the policy, and the error is
+ * emitted only once the policy's deadline has passed. Blocking operations
+ * are not affected; their maximum wait is set by setTimeout().
+ */
+void Manager::setRetryPolicy(const RetryPolicy &policy)
+{
+    d->m_retryPolicy = policy;
+}
+
+/*!
+ * @return The policy used when retrying operations on a locked database.
+ * @see setRetryPolicy()
+ */
+RetryPolicy Manager::retryPolicy() const
+{
+    return d->m_retryPolicy;
+}
+
+/*!
+ * Enables or disables the merging of repeated Account::sync() calls.
+ * @param enabled Whether sync() calls should be merged; the default is
+ * false.
+ *
+ * When enabled, calling Account::sync() while a previous store operation on
+ * the same account is still in progress does not start a new one right
+ * away: at most one further store is queued, and it writes all the changes
+ * made in the meantime. The account then emits a single synced() or error()
+ * signal, carrying the result of the last store, for all the merged calls.
+ */
+void Manager::setSyncCoalescing(bool enabled)
+{
+    d->m_syncCoalescing = enabled;
+}
+
+/*!
+ * @return Whether repeated Account::sync() calls are merged.
+ * @see setSyncCoalescing()
+ */
+bool Manager::syncCoalescing() const
+{
+    return d->m_syncCoalescing;
+}
+
+/*!
+ * Enables or disables the collection of statistics about the operations
+ * performed by this manager and by the accounts loaded through it.
+ * @param enabled Whether statistics should be collected; the default is
+ * false.
+ *
+ * Disabling the collection does not clear the statistics gathered so far;
+ * use resetStatistics() for that.
+ * @see statistics()
+ */
+void Manager::setStatisticsEnabled(bool enabled)
+{
+    d->m_statisticsEnabled = enabled;
+}
+
+/*!
+ * @return Whether statistics are being collected.
+ * @see setStatisticsEnabled()
+ */
+bool Manager::statisticsEnabled() const
+{
+    return d->m_statisticsEnabled;
+}
+
+/*!
+ * @return The statistics collected since they were enabled, or last reset.
+ * @see setStatisticsEnabled()
+ */
+Statistics Manager::statistics() const
+{
+    return d->m_statistics;
+}
+
+/*!
+ * Clears the collected statistics.
+ */
+void Manager::resetStatistics()
+{
+    d->m_statistics = Statistics();
 }
 
 /*!
@@ -559,12 +1679,14 @@ bool Manager::abortOnTimeout() const
  */
 Manager::Options Manager::options() const
 {
+    if (d->m_initializationPending) return d->m_options;
+
     gboolean useDBus = true;
     g_object_get(d->m_manager,
                  "use-dbus", &useDBus,
                  NULL);
 
-    Options opts;
+    Options opts = d->m_options & (ShareBackend | LazyInitialization);
     if (!useDBus) {
         opts |= DisableNotifications;
     }
@@ -25,15 +25,21 @@
 #ifndef ACCOUNTS_MANAGER_H
 #define ACCOUNTS_MANAGER_H
 
+#include <QHash>
 #include <QObject>
 #include <QSettings>
 #include <QString>
 #include <QStringList>
 
+#include <functional>
+
 #include "Accounts/accountscommon.h"
 #include "Accounts/account.h"
+#include "Accounts/account-data.h"
 #include "Accounts/error.h"
 #include "Accounts/provider.h"
+#include "Accounts/retry-policy.h"
+#include "Accounts/statistics.h"
 #include "Accounts/service.h"
 #include "Accounts/service-type.h"
 
@@ -44,6 +50,7 @@ namespace Accounts
 {
 
 class AccountService;
+class AccountServicePrivate;
 class Application;
 
 typedef QList<Application> ApplicationList;
@@ -59,24 +66,47 @@ public:
      */
     enum Option {
         DisableNotifications = 0x1, /**< Disable all inter-process notifications */
+        ShareBackend = 0x2, /**< Share the connection to the accounts DB,
+                               and the state of the accounts */
+        LazyInitialization = 0x4, /**< Connect to the DB on first use */
     };
     Q_DECLARE_FLAGS(Options, Option)
 
     Manager(QObject *parent = 0);
     Manager(const QString &serviceType, QObject *parent = 0);
     Manager(Options options, QObject *parent = 0);
+    Manager(const QString &serviceType, Options options, QObject *parent = 0);
     ~Manager();
 
     Account *account(const AccountId &id) const;
+    QList<Account *> accounts(const AccountIdList &ids,
+                              QHash<AccountId, Error> *errors = 0) const;
+    AccountDataList accountData(const AccountIdList &ids,
+                                QHash<AccountId, Error> *errors = 0) const;
+
+    void setAccountCacheLimit(int limit);
+    int accountCacheLimit() const;
 
     AccountIdList accountList(const QString &serviceType = QString::null) const;
     AccountIdList accountListEnabled(const QString &serviceType = QString::null) const;
 
+    int accountCount(const QString &serviceType = QString()) const;
+    int enabledAccountCount(const QString &serviceType = QString()) const;
+
+    int forEachAccount(const QString &serviceType,
+                       const std::function<bool(Account *)> &callback) const;
+    int forEachEnabledAccount(const QString &serviceType,
+                              const std::function<bool(Account *)> &callback)
+        const;
+
     Account *createAccount(const QString &providerName);
 
+    quint32 syncAccounts(const QList<Account *> &accounts);
+
     Service service(const QString &serviceName) const;
     ServiceList serviceList(const QString &serviceType = QString::null) const;
     ServiceList serviceList(const Application &application) const;
+    ServiceList serviceListByTag(const QString &tag) const;
 
     Provider provider(const QString &providerName) const;
     ProviderList providerList() const;
@@ -94,6 +124,23 @@ public:
     void setAbortOnTimeout(bool abort);
     bool abortOnTimeout() const;
 
+    void setRetryPolicy(const RetryPolicy &policy);
+    RetryPolicy retryPolicy() const;
+
+    void setSyncCoalescing(bool enabled);
+    bool syncCoalescing() const;
+
+    void setStatisticsEnabled(bool enabled);
+    bool statisticsEnabled() const;
+    Statistics statistics() const;
+    void resetStatistics();
+
+    void setCoalescingInterval(int interval);
+    int coalescingInterval() const;
+
+    bool watchKey(const QString &serviceName, const QString &key);
+    void unwatchKey(const QString &serviceName, const QString &key);
+
     Options options() const;
 
     Error lastError() const;
@@ -103,6 +150,14 @@ Q_SIGNALS:
     void accountRemoved(Accounts::AccountId id);
     void accountUpdated(Accounts::AccountId id);
     void enabledEvent(Accounts::AccountId id);
+    void accountsUpdated(const Accounts::AccountIdList &ids);
+    void enabledEvents(const Accounts::AccountIdList &ids);
+    void accountsSynced(quint32 batchId, Accounts::Error error);
+    void keyChanged(Accounts::AccountId id, const QString &serviceName,
+                    const QString &key, const QVariant &value);
+
+protected:
+    void connectNotify(const QMetaMethod &signal) Q_DECL_OVERRIDE;
 
 private:
 
@@ -113,6 +168,7 @@ private:
 
     friend class Account;
     friend class AccountService;
+    friend class AccountServicePrivate;
     // \endcond
 }; // Manager
 
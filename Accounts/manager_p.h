@@ -23,12 +23,19 @@
  */
 
 #include "account.h"
+#include "application.h"
 #include "manager.h"
 
+#include <QElapsedTimer>
 #include <QHash>
+#include <QMap>
 #include <QPointer>
+#include <QSet>
 #include <libaccounts-glib/ag-manager.h>
 
+class QFileSystemWatcher;
+class QTimer;
+
 namespace Accounts {
 
 class Manager::Private
@@ -38,7 +45,17 @@ class Manager::Private
 public:
     Private():
         q_ptr(0),
-        m_manager(0)
+        m_manager(0),
+        m_initializationPending(false),
+        m_accountsUseCounter(0),
+        m_accountCacheLimit(0),
+        m_catalogWatcher(0),
+        m_catalogGeneration(0),
+        m_syncCoalescing(false),
+        m_statisticsEnabled(false),
+        m_lastSyncBatchId(0),
+        m_coalescingInterval(-1),
+        m_coalescingTimer(0)
     {
     }
 
@@ -46,16 +63,140 @@ public:
     }
 
     void init(Manager *q, AgManager *manager);
+    void create(Manager *q, const QString &serviceType, Options options);
+    void initialize();
+
+    AgManager *backend() {
+        if (Q_UNLIKELY(m_initializationPending)) initialize();
+        return m_manager;
+    }
+
+    static AgManager *newBackend(const QString &serviceType,
+                                 Options options, GError **error);
+    static AgManager *sharedBackend(const QString &serviceType,
+                                    Options options, GError **error);
+
+    GList *listAccounts(const QString &serviceType, bool enabledOnly);
+    int forEachAccount(GList *list,
+                       const std::function<bool(Account *)> &callback);
+
+    Account *cachedAccount(AccountId id);
+    void cacheAccount(AccountId id, Account *account);
+    void uncacheAccount(AccountId id);
+    /* Accounts used since firstKeptUse are never dropped */
+    void trimAccountCache(quint64 firstKeptUse = ~quint64(0));
+    static bool isAccountInUse(Account *account);
+
+    struct CachedAccount {
+        QPointer<Account> account;
+        quint64 lastUse;
+    };
+
+    /* Snapshot of the services, providers and applications installed in the
+     * system, built once and then queried through its indexes. */
+    struct Catalog {
+        Catalog(): isValid(false) {}
+
+        bool isValid;
+        ServiceList services;
+        QHash<QString,Service> servicesByName;
+        QHash<QString,ServiceList> servicesByType;
+        QHash<QString,ServiceList> servicesByProvider;
+        QHash<QString,ServiceList> servicesByTag;
+        QHash<QString,ServiceList> servicesByApplication;
+        QHash<QString,ApplicationList> applicationsByService;
+        ProviderList providers;
+        QHash<QString,Provider> providersByName;
+    };
+
+    Catalog &catalog();
+    void invalidateCatalog();
+    void watchCatalogDirectories();
+    bool addCatalogWatches();
+
+    void record(Statistics::Operation operation, qint64 usecs = 0) {
+        if (m_statisticsEnabled) m_statistics.record(operation, usecs);
+    }
+
+    /* Records the duration of the enclosing scope in the statistics of the
+     * given manager */
+    class Measurement
+    {
+    public:
+        Measurement(Manager *manager, Statistics::Operation operation):
+            m_d((manager != 0 && manager->d->m_statisticsEnabled) ?
+                manager->d : 0),
+            m_operation(operation)
+        {
+            if (m_d != 0) m_timer.start();
+        }
+        ~Measurement() {
+            if (m_d != 0) {
+                m_d->record(m_operation, m_timer.nsecsElapsed() / 1000);
+            }
+        }
+    private:
+        Private *m_d;
+        Statistics::Operation m_operation;
+        QElapsedTimer m_timer;
+    };
+
+    void queueEvent(AccountIdList &queue, QSet<AccountId> &queued,
+                    AccountId id);
+    void flushQueuedEvents();
+
+    /* A key watched on all the accounts with Manager::watchKey() */
+    struct KeyWatch {
+        QString serviceName;
+        QString serviceType;
+        QString key;
+    };
+
+    AgManager *watchBackend(const QString &serviceType);
+    void releaseWatchBackend(const QString &serviceType);
+    static QVariant readWatchedKey(AgManager *backend, AgAccount *account,
+                                   const KeyWatch &watch);
+    void notifyWatchedKeys(AgManager *backend, AgAccountId id,
+                           bool onlyIfSet);
 
     mutable Manager *q_ptr;
     AgManager *m_manager; //real manager
     Error lastError;
-    QHash<AccountId,QPointer<Account> > m_accounts;
+    Options m_options;
+    QString m_serviceType;
+    bool m_initializationPending;
+    QHash<AccountId,CachedAccount> m_accounts;
+    QMap<quint64,AccountId> m_accountsByUse; // least recently used first
+    quint64 m_accountsUseCounter;
+    int m_accountCacheLimit;
+    Catalog m_catalog;
+    QFileSystemWatcher *m_catalogWatcher;
+    QStringList m_catalogDirectories;
+    quint32 m_catalogGeneration; // incremented when the catalog changes
+    RetryPolicy m_retryPolicy;
+    bool m_syncCoalescing;
+    bool m_statisticsEnabled;
+    Statistics m_statistics;
+    quint32 m_lastSyncBatchId;
+    int m_coalescingInterval;
+    QTimer *m_coalescingTimer;
+    AccountIdList m_updatedAccounts;
+    QSet<AccountId> m_updatedAccountsSet;
+    AccountIdList m_enabledEvents;
+    QSet<AccountId> m_enabledEventsSet;
+    QList<KeyWatch> m_keyWatches;
+    /* Backends notifying the changes to the services of the watched keys,
+     * indexed by service type */
+    QHash<QString,AgManager*> m_watchBackends;
 
     static void on_account_created(Manager *self, AgAccountId id);
     static void on_account_deleted(Manager *self, AgAccountId id);
     static void on_account_updated(Manager *self, AgAccountId id);
     static void on_enabled_event(Manager *self, AgAccountId id);
+    static void on_watched_account_created(AgManager *backend,
+                                           AgAccountId id, Manager *self);
+    static void on_watched_account_updated(AgManager *backend,
+                                           AgAccountId id, Manager *self);
 };
 
 } //namespace Accounts
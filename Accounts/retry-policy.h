@@ -0,0 +1,112 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTS_RETRY_POLICY_H
+#define ACCOUNTS_RETRY_POLICY_H
+
+#include <QtGlobal>
+
+#include <Accounts/accountscommon.h>
+
+namespace Accounts {
+
+/*!
+ * @class RetryPolicy
+ * @headerfile retry-policy.h Accounts/RetryPolicy
+ * @brief Describes how operations failing because of a locked database are
+ * retried.
+ *
+ * @details After the first failure, the operation is retried after
+ * initialDelay() milliseconds; each subsequent delay is twice the previous
+ * one, up to maxDelay(). Every delay is randomly shortened or lengthened by
+ * up to the jitter() fraction of its value, so that several processes
+ * competing for the database don't retry in lockstep. Once deadline()
+ * milliseconds have passed since the first failure, the operation fails
+ * with Error::DatabaseLocked.
+ *
+ * @see Manager::setRetryPolicy()
+ */
+class ACCOUNTS_EXPORT RetryPolicy
+{
+public:
+    /*!
+     * Constructs an invalid policy: operations are not retried.
+     */
+    RetryPolicy():
+        m_initialDelay(0), m_maxDelay(0), m_deadline(0), m_jitter(0) {}
+
+    /*!
+     * Constructor.
+     * @param initialDelay Delay before the first retry, in milliseconds.
+     * @param maxDelay Upper bound for the delay between two retries, in
+     * milliseconds.
+     * @param deadline Time after which the operation is no longer retried,
+     * in milliseconds.
+     * @param jitter Maximum random variation of each delay, as a fraction of
+     * the delay itself (between 0 and 1).
+     */
+    RetryPolicy(int initialDelay, int maxDelay, int deadline,
+                qreal jitter = 0.25):
+        m_initialDelay(qMax(initialDelay, 1)),
+        m_maxDelay(qMax(maxDelay, m_initialDelay)),
+        m_deadline(qMax(deadline, 0)),
+        m_jitter(qBound(qreal(0), jitter, qreal(1))) {}
+
+    /*!
+     * @return Whether operations are retried at all.
+     */
+    bool isValid() const { return m_deadline > 0; }
+
+    /*!
+     * @return The delay before the first retry, in milliseconds.
+     */
+    int initialDelay() const { return m_initialDelay; }
+
+    /*!
+     * @return The maximum delay between two retries, in milliseconds.
+     */
+    int maxDelay() const { return m_maxDelay; }
+
+    /*!
+     * @return The time after which the operation is no longer retried, in
+     * milliseconds.
+     */
+    int deadline() const { return m_deadline; }
+
+    /*!
+     * @return The maximum random variation of each delay.
+     */
+    qreal jitter() const { return m_jitter; }
+
+private:
+    // Don't include private data in docs: \cond
+    int m_initialDelay;
+    int m_maxDelay;
+    int m_deadline;
+    qreal m_jitter;
+    // \endcond
+};
+
+} //namespace
+
+#endif // ACCOUNTS_RETRY_POLICY_H
@@ -0,0 +1,93 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTS_SETTING_KEY_H
+#define ACCOUNTS_SETTING_KEY_H
+
+#include <QByteArray>
+#include <QString>
+
+#include <Accounts/accountscommon.h>
+
+namespace Accounts {
+
+/*!
+ * @class SettingKey
+ * @headerfile setting-key.h Accounts/SettingKey
+ * @brief The name of an account setting, encoded once for repeated use.
+ *
+ * @details Setting names are stored as Latin-1 strings; the methods taking
+ * the key as a QString convert it on every call. Clients accessing the same
+ * keys very often can build a SettingKey once and pass it to the overloads
+ * of Account::value(), Account::setValue(), Account::remove(),
+ * Account::watchKey(), AccountService::value(), AccountService::setValue()
+ * and AccountService::remove(), which don't allocate memory for building the
+ * full key name.
+ *
+ * Like the QString keys, a SettingKey is relative to the current group.
+ */
+class ACCOUNTS_EXPORT SettingKey
+{
+public:
+    /*!
+     * Constructs an empty key.
+     */
+    SettingKey() {}
+
+    /*!
+     * Constructor.
+     * @param key The name of the setting.
+     */
+    explicit SettingKey(const QString &key): m_key(key.toLatin1()) {}
+
+    /*!
+     * Constructor.
+     * @param key The name of the setting, in Latin-1 encoding.
+     */
+    explicit SettingKey(const char *key): m_key(key) {}
+
+    /*!
+     * @return Whether the key is empty.
+     */
+    bool isEmpty() const { return m_key.isEmpty(); }
+
+    /*!
+     * @return The name of the setting.
+     */
+    QString toString() const { return QString::fromLatin1(m_key); }
+
+    /*!
+     * @return The name of the setting, in Latin-1 encoding.
+     */
+    const QByteArray &toLatin1() const { return m_key; }
+
+private:
+    // Don't include private data in docs: \cond
+    QByteArray m_key;
+    // \endcond
+};
+
+} //namespace
+
+#endif // ACCOUNTS_SETTING_KEY_H
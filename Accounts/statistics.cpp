@@ -0,0 +1,186 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "statistics.h"
+
+#include <QSharedData>
+
+namespace Accounts {
+
+/*!
+ * @class Statistics
+ * @headerfile statistics.h Accounts/Statistics
+ * @brief Counters and latency histograms of the operations performed by a
+ * Manager and by its accounts.
+ *
+ * @details For each Operation, the object records how many times it has been
+ * performed, the total and maximum time spent on it, and how many times its
+ * duration fell into each of the histogram buckets. Bucket \c i counts the
+ * operations lasting less than bucketLimit(i) microseconds (and at least
+ * bucketLimit(i - 1)); the last bucket has no upper limit.
+ *
+ * CacheHit and CacheMiss events have no duration, and are always counted in
+ * the first bucket.
+ *
+ * Statistics is an implicitly shared value type: copying it is cheap.
+ *
+ * @see Manager::statistics()
+ */
+
+enum {
+    OperationCount = Statistics::LockWait + 1,
+    BucketCount = 8,
+};
+
+class Statistics::Private: public QSharedData
+{
+public:
+    Private();
+
+    bool isValid(Operation operation) const {
+        return operation >= 0 && operation < OperationCount;
+    }
+
+    quint64 counts[OperationCount];
+    qint64 totalTimes[OperationCount];
+    qint64 maxTimes[OperationCount];
+    quint64 histograms[OperationCount][BucketCount];
+};
+
+Statistics::Private::Private()
+{
+    for (int op = 0; op < OperationCount; op++) {
+        counts[op] = 0;
+        totalTimes[op] = 0;
+        maxTimes[op] = 0;
+        for (int i = 0; i < BucketCount; i++) histograms[op][i] = 0;
+    }
+}
+
+}; // namespace
+
+using namespace Accounts;
+
+/*!
+ * Constructs an empty set of statistics.
+ */
+Statistics::Statistics():
+    d(new Private)
+{
+}
+
+/*!
+ * Copy constructor. Copying a Statistics object is very cheap, because the
+ * data is shared among copies.
+ */
+Statistics::Statistics(const Statistics &other):
+    d(other.d)
+{
+}
+
+/*!
+ * Assignment operator.
+ */
+Statistics &Statistics::operator=(const Statistics &other)
+{
+    d = other.d;
+    return *this;
+}
+
+/*!
+ * Destructor.
+ */
+Statistics::~Statistics()
+{
+}
+
+/*!
+ * @return How many times the operation has been performed.
+ */
+quint64 Statistics::count(Operation operation) const
+{
+    return d->isValid(operation) ? d->counts[operation] : 0;
+}
+
+/*!
+ * @return The total time spent on the operation, in microseconds.
+ */
+qint64 Statistics::totalTime(Operation operation) const
+{
+    return d->isValid(operation) ? d->totalTimes[operation] : 0;
+}
+
+/*!
+ * @return The duration of the slowest occurrence of the operation, in
+ * microseconds.
+ */
+qint64 Statistics::maxTime(Operation operation) const
+{
+    return d->isValid(operation) ? d->maxTimes[operation] : 0;
+}
+
+/*!
+ * @return How many occurrences of the operation fell into the given
+ * histogram bucket.
+ */
+quint64 Statistics::histogram(Operation operation, int bucket) const
+{
+    return (d->isValid(operation) && bucket >= 0 && bucket < BucketCount) ?
+        d->histograms[operation][bucket] : 0;
+}
+
+/*!
+ * @return The number of histogram buckets.
+ */
+int Statistics::bucketCount()
+{
+    return BucketCount;
+}
+
+/*!
+ * @return The upper limit of the given histogram bucket, in
+ * microseconds, or -1 for the last bucket. The limits are 10, 100,
+ * 1000 microseconds and so on.
+ */
+qint64 Statistics::bucketLimit(int bucket)
+{
+    if (bucket < 0 || bucket >= BucketCount - 1) return -1;
+    qint64 limit = 10;
+    for (int i = 0; i < bucket; i++) limit *= 10;
+    return limit;
+}
+
+void Statistics::record(Operation operation, qint64 usecs)
+{
+    if (!d->isValid(operation)) return;
+
+    d->counts[operation]++;
+    d->totalTimes[operation] += usecs;
+    if (usecs > d->maxTimes[operation]) d->maxTimes[operation] = usecs;
+
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && usecs >= bucketLimit(bucket)) {
+        bucket++;
+    }
+    d->histograms[operation][bucket]++;
+}
@@ -0,0 +1,84 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTS_STATISTICS_H
+#define ACCOUNTS_STATISTICS_H
+
+#include <QSharedDataPointer>
+#include <QtGlobal>
+
+#include <Accounts/accountscommon.h>
+
+namespace Accounts {
+
+class Manager;
+
+class ACCOUNTS_EXPORT Statistics
+{
+public:
+    /*!
+     * @enum Operation
+     * @brief The monitored operations.
+     *
+     * New operations might be appended in future versions of the library.
+     */
+    enum Operation {
+        LoadAccount = 0, /**< Loading an account from the DB */
+        ListAccounts, /**< Listing the account IDs */
+        StoreAsync, /**< An asynchronous store operation, until completion */
+        StoreBlocking, /**< A blocking store operation */
+        ReadValue, /**< Reading an account setting */
+        WriteValue, /**< Writing or removing an account setting */
+        SignalDelivery, /**< Emitting a notification to the clients */
+        CacheHit, /**< An account found in the Manager's cache */
+        CacheMiss, /**< An account not found in the Manager's cache */
+        LockWait, /**< A store operation failed on a locked DB */
+    };
+
+    Statistics();
+    Statistics(const Statistics &other);
+    Statistics &operator=(const Statistics &other);
+    ~Statistics();
+
+    quint64 count(Operation operation) const;
+    qint64 totalTime(Operation operation) const;
+    qint64 maxTime(Operation operation) const;
+    quint64 histogram(Operation operation, int bucket) const;
+
+    static int bucketCount();
+    static qint64 bucketLimit(int bucket);
+
+private:
+    // Don't include private data in docs: \cond
+    friend class Manager;
+
+    void record(Operation operation, qint64 usecs);
+
+    class Private;
+    QSharedDataPointer<Private> d;
+    // \endcond
+};
+
+} //namespace
+
+#endif // ACCOUNTS_STATISTICS_H
@@ -150,4 +150,69 @@ GVariant *qVariantToGVariant(const QVariant &variant)
     return ret;
 }
 
+template <typename T>
+static bool integerFromGVariant(GVariant *value, T *result)
+{
+    switch (g_variant_classify(value))
+    {
+    case G_VARIANT_CLASS_INT32:
+        *result = T(g_variant_get_int32(value));
+        return true;
+    case G_VARIANT_CLASS_UINT32:
+        *result = T(g_variant_get_uint32(value));
+        return true;
+    case G_VARIANT_CLASS_INT64:
+        *result = T(g_variant_get_int64(value));
+        return true;
+    case G_VARIANT_CLASS_UINT64:
+        *result = T(g_variant_get_uint64(value));
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool fromGVariant(GVariant *value, int *result)
+{
+    return integerFromGVariant(value, result);
+}
+
+bool fromGVariant(GVariant *value, uint *result)
+{
+    return integerFromGVariant(value, result);
+}
+
+bool fromGVariant(GVariant *value, qint64 *result)
+{
+    return integerFromGVariant(value, result);
+}
+
+bool fromGVariant(GVariant *value, quint64 *result)
+{
+    return integerFromGVariant(value, result);
+}
+
+bool fromGVariant(GVariant *value, bool *result)
+{
+    if (g_variant_classify(value) != G_VARIANT_CLASS_BOOLEAN) return false;
+    *result = g_variant_get_boolean(value);
+    return true;
+}
+
+bool fromGVariant(GVariant *value, QString *result)
+{
+    if (g_variant_classify(value) != G_VARIANT_CLASS_STRING) return false;
+    *result = UTF8(g_variant_get_string(value, NULL));
+    return true;
+}
+
+bool fromGVariant(GVariant *value, QStringList *result)
+{
+    if (!g_variant_is_of_type(value, G_VARIANT_TYPE_STRING_ARRAY)) {
+        return false;
+    }
+    *result = gVariantToQStringList(value);
+    return true;
+}
+
 }; // namespace
@@ -24,6 +24,10 @@
 #ifndef ACCOUNTS_UTILS_H
 #define ACCOUNTS_UTILS_H
 
+#include "Accounts/setting-key.h"
+
+#include <QStringList>
+#include <QVarLengthArray>
 #include <QVariant>
 #undef signals
 #include <glib-object.h>
@@ -33,6 +37,52 @@ namespace Accounts {
 QVariant gVariantToQVariant(GVariant *value);
 GVariant *qVariantToGVariant(const QVariant &variant);
 
+/* Direct conversions, for the types matching the GVariant value; they
+ * return false if the value has a different type */
+bool fromGVariant(GVariant *value, int *result);
+bool fromGVariant(GVariant *value, uint *result);
+bool fromGVariant(GVariant *value, qint64 *result);
+bool fromGVariant(GVariant *value, quint64 *result);
+bool fromGVariant(GVariant *value, bool *result);
+bool fromGVariant(GVariant *value, QString *result);
+bool fromGVariant(GVariant *value, QStringList *result);
+
+template <typename T>
+bool gVariantToValue(GVariant *value, T *result)
+{
+    if (fromGVariant(value, result)) return true;
+
+    /* Other types need a conversion, which QVariant knows how to do */
+    QVariant variant = gVariantToQVariant(value);
+    if (!variant.convert(qMetaTypeId<T>())) return false;
+    *result = variant.value<T>();
+    return true;
+}
+
+/* Full name of a setting, given the Latin-1 encoded group prefix; unless the
+ * name is very long, it's built without allocating memory on the heap */
+class KeyBuffer
+{
+public:
+    KeyBuffer(const QByteArray &prefix, const SettingKey &key) {
+        const QByteArray &name = key.toLatin1();
+        if (prefix.isEmpty()) {
+            m_key = name.constData();
+            return;
+        }
+        m_buffer.append(prefix.constData(), prefix.size());
+        /* include the terminating NUL */
+        m_buffer.append(name.constData(), name.size() + 1);
+        m_key = m_buffer.constData();
+    }
+
+    const char *constData() const { return m_key; }
+
+private:
+    QVarLengthArray<char,256> m_buffer;
+    const char *m_key;
+};
+
 } // namespace
 
 #endif // ACCOUNTS_UTILS_H
@@ -0,0 +1,136 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "watch-dispatcher.h"
+
+#include <QMap>
+
+using namespace Accounts;
+
+static QChar slash = QChar::fromLatin1('/');
+
+static bool isGroup(const QString &key)
+{
+    return key.isEmpty() || key.endsWith(slash);
+}
+
+WatchDispatcher::WatchDispatcher()
+{
+}
+
+WatchDispatcher::~WatchDispatcher()
+{
+}
+
+void WatchDispatcher::addWatch(quint32 id, const QString &key,
+                               const Callback &callback)
+{
+    Watch &watch = m_watches[id];
+    watch.key = key;
+    watch.callback = callback;
+
+    Node *node = &m_root;
+    Q_FOREACH (const QString &component,
+               key.split(slash, QString::SkipEmptyParts)) {
+        Node *&child = node->children[component];
+        if (child == 0) child = new Node;
+        node = child;
+    }
+
+    if (isGroup(key)) {
+        node->groupWatches.append(id);
+    } else {
+        node->keyWatches.append(id);
+    }
+}
+
+bool WatchDispatcher::removeWatch(quint32 id)
+{
+    QHash<quint32,Watch>::iterator i = m_watches.find(id);
+    if (i == m_watches.end()) return false;
+
+    const QString key = i->key;
+    m_watches.erase(i);
+
+    /* Find the node, remembering the path to prune the empty branches */
+    QList<Node*> path;
+    Node *node = &m_root;
+    const QStringList components = key.split(slash, QString::SkipEmptyParts);
+    Q_FOREACH (const QString &component, components) {
+        path.append(node);
+        node = node->children.value(component);
+        Q_ASSERT(node != 0);
+    }
+
+    if (isGroup(key)) {
+        node->groupWatches.removeOne(id);
+    } else {
+        node->keyWatches.removeOne(id);
+    }
+
+    for (int depth = components.count() - 1;
+         depth >= 0 && node->isEmpty(); depth--) {
+        Node *parent = path.at(depth);
+        parent->children.remove(components.at(depth));
+        delete node;
+        node = parent;
+    }
+    return true;
+}
+
+void WatchDispatcher::dispatch(const QStringList &changedKeys)
+{
+    /* Ordered by id, so that subscribers are invoked in the same order as
+     * they were registered */
+    QMap<quint32,QStringList> matches;
+
+    Q_FOREACH (const QString &key, changedKeys) {
+        const QStringList components =
+            key.split(slash, QString::SkipEmptyParts);
+        const Node *node = &m_root;
+        for (int i = 0; node != 0; i++) {
+            if (i == components.count()) {
+                Q_FOREACH (quint32 id, node->keyWatches) {
+                    matches[id].append(key);
+                }
+                break;
+            }
+            Q_FOREACH (quint32 id, node->groupWatches) {
+                matches[id].append(key);
+            }
+            node = node->children.value(components.at(i));
+        }
+    }
+
+    for (QMap<quint32,QStringList>::const_iterator i = matches.constBegin();
+         i != matches.constEnd(); i++) {
+        /* A previous callback might have removed this watch */
+        QHash<quint32,Watch>::const_iterator watch =
+            m_watches.constFind(i.key());
+        if (watch == m_watches.constEnd()) continue;
+        /* Copied, since the callback might remove its own watch */
+        Callback callback = watch->callback;
+        callback(i.value());
+    }
+}
@@ -0,0 +1,89 @@
+/* vi: set et sw=4 ts=4 cino=t0,(0: */
+/*
+ * This file is part of libaccounts-qt
+ *
+ * Copyright (C) 2026 Canonical Ltd.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@canonical.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTS_WATCH_DISPATCHER_H
+#define ACCOUNTS_WATCH_DISPATCHER_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+#include <functional>
+
+namespace Accounts {
+
+/* Routes the changes of the settings of an account service to the
+ * subscribers watching them. Subscribers register either on a key, or on a
+ * group (when the key is empty or ends with a slash), and are stored in a
+ * trie indexed by the components of the key path; this way the cost of a
+ * notification depends on the depth of the changed keys and not on the
+ * number of subscribers.
+ *
+ * A single libaccounts-glib watch per account service feeds the
+ * dispatcher, instead of one watch per subscriber. */
+class WatchDispatcher
+{
+public:
+    typedef std::function<void(const QStringList &keys)> Callback;
+
+    WatchDispatcher();
+    ~WatchDispatcher();
+
+    void addWatch(quint32 id, const QString &key, const Callback &callback);
+    bool removeWatch(quint32 id);
+    bool isEmpty() const { return m_watches.isEmpty(); }
+
+    /* Invokes, once for each interested subscriber, the callbacks of the
+     * subscribers watching any of the given keys, passing the matching
+     * keys. Callbacks are allowed to add or remove watches. */
+    void dispatch(const QStringList &changedKeys);
+
+private:
+    struct Node {
+        ~Node() { qDeleteAll(children); }
+        bool isEmpty() const {
+            return children.isEmpty() && keyWatches.isEmpty() &&
+                groupWatches.isEmpty();
+        }
+
+        QHash<QString,Node*> children;
+        QList<quint32> keyWatches;
+        QList<quint32> groupWatches;
+    };
+
+    struct Watch {
+        QString key;
+        Callback callback;
+    };
+
+    Q_DISABLE_COPY(WatchDispatcher)
+
+    Node m_root;
+    QHash<quint32,Watch> m_watches;
+};
+
+} // namespace
+
+#endif // ACCOUNTS_WATCH_DISPATCHER_H
@@ -23,9 +23,11 @@
  */
 #include <QtTest/QtTest>
 #include <QSignalSpy>
+#include <sqlite3.h>
 
 #include "Accounts/Account"
 #include "Accounts/Application"
+#include "Accounts/AsyncManager"
 #include "Accounts/Manager"
 #include "Accounts/AccountService"
 
@@ -47,6 +49,7 @@ class AccountsTest: public QObject
 public:
     AccountsTest() {
         qRegisterMetaType<AccountId>("Accounts::AccountId");
+        qRegisterMetaType<AccountIdList>("Accounts::AccountIdList");
         qRegisterMetaType<const char *>("const char *");
     }
 
@@ -55,14 +58,22 @@ private Q_SLOTS:
     void cleanupTestCase();
 
     void testManager();
+    void testSharedBackend();
+    void testLazyInitialization();
+    void testStatistics();
     void testCreateAccount();
     void testAccount();
     void testObjectsLifetime();
+    void testAccountsBatch();
+    void testAccountCache();
     void testAccountList();
+    void testForEachAccount();
+    void testAccountData();
 
     void testProvider();
     void testService();
     void testServiceList();
+    void testServiceCatalog();
     void testServiceConst();
     void testAccountConst();
 
@@ -71,7 +82,16 @@ private Q_SLOTS:
     void testAccountEnabled();
     void testAccountDisplayName();
     void testAccountValue();
+    void testAccountValues();
+    void testSettingKey();
+    void testTypedValues();
     void testAccountSync();
+    void testSyncAccounts();
+    void testSyncCoalescing();
+    void testSyncTimeout();
+    void testStoreRetry();
+    void testCancelSync();
+    void testPendingChanges();
 
     void testCreated();
     void testRemove();
@@ -79,9 +99,13 @@ private Q_SLOTS:
     void testAccountService();
 
     void testWatches();
+    void testWatchCallbacks();
+    void testWatchBatching();
+    void testManagerWatchKey();
 
     void testServiceData();
     void testSettings();
+    void testSettingsIndex();
 
     void testKeySignVerify();
 
@@ -90,6 +114,7 @@ private Q_SLOTS:
     void testSelectGlobalAccountSettings();
 
     void testCredentialsId();
+    void testValueWithFallback();
     void testAuthData();
     void testGlobalAuthData();
 
@@ -98,8 +123,10 @@ private Q_SLOTS:
     void testEnabledEvent();
     void testServiceType();
     void testUpdateAccount();
+    void testCoalescedEvents();
     void testApplication();
     void testApplicationListServices();
+    void testAsyncManager();
 
 public Q_SLOTS:
     void onAccountServiceChanged();
@@ -145,6 +172,16 @@ void AccountsTest::testManager()
 
     QCOMPARE(mgr->options().testFlag(Manager::DisableNotifications), false);
 
+    QVERIFY(!mgr->retryPolicy().isValid());
+    mgr->setRetryPolicy(RetryPolicy(10, 500, 3000, 0.5));
+    QVERIFY(mgr->retryPolicy().isValid());
+    QCOMPARE(mgr->retryPolicy().initialDelay(), 10);
+    QCOMPARE(mgr->retryPolicy().maxDelay(), 500);
+    QCOMPARE(mgr->retryPolicy().deadline(), 3000);
+    QCOMPARE(mgr->retryPolicy().jitter(), qreal(0.5));
+    mgr->setRetryPolicy(RetryPolicy());
+    QVERIFY(!mgr->retryPolicy().isValid());
+
     delete mgr;
 
     mgr = new Manager(Manager::DisableNotifications);
@@ -152,6 +189,165 @@ void AccountsTest::testManager()
     delete mgr;
 }
 
+void AccountsTest::testSharedBackend()
+{
+    Manager *mgr1 = new Manager(Manager::ShareBackend);
+    QVERIFY(mgr1->options().testFlag(Manager::ShareBackend));
+    QVERIFY(!mgr1->options().testFlag(Manager::DisableNotifications));
+    Manager *mgr2 = new Manager(QString(), Manager::ShareBackend);
+    Manager *other = new Manager();
+
+    /* The DB settings are shared by managers using the same backend */
+    mgr1->setTimeout(1234);
+    QCOMPARE(mgr2->timeout(), quint32(1234));
+    QVERIFY(other->timeout() != quint32(1234));
+
+    /* Different parameters require a different backend */
+    Manager *typed = new Manager(EMAIL_SERVICE_TYPE, Manager::ShareBackend);
+    QCOMPARE(typed->serviceType(), EMAIL_SERVICE_TYPE);
+    QVERIFY(typed->timeout() != quint32(1234));
+    Manager *quiet = new Manager(Manager::ShareBackend |
+                                 Manager::DisableNotifications);
+    QVERIFY(quiet->options().testFlag(Manager::DisableNotifications));
+    QVERIFY(quiet->timeout() != quint32(1234));
+
+    /* All the managers sharing the backend get notified */
+    clearDb();
+    QSignalSpy created1(mgr1, SIGNAL(accountCreated(Accounts::AccountId)));
+    QSignalSpy created2(mgr2, SIGNAL(accountCreated(Accounts::AccountId)));
+    Account *account = mgr2->createAccount(PROVIDER);
+    account->syncAndBlock();
+    QTRY_COMPARE(created1.count(), 1);
+    QTRY_COMPARE(created2.count(), 1);
+    AccountId id = account->id();
+    delete account;
+
+    /* So is the state of the accounts: the selected service and the
+     * changes which have not been stored yet */
+    Account *account1 = mgr1->account(id);
+    Account *account2 = mgr2->account(id);
+    QVERIFY(account1 != account2);
+    account1->setValue("shared", QString("yes"));
+    QCOMPARE(account2->value("shared").toString(), QString("yes"));
+    Service service = mgr1->service(MYSERVICE);
+    account1->selectService(service);
+    QCOMPARE(account2->selectedService(), service);
+    account1->selectService();
+    account1->remove("shared");
+
+    /* The backend stays alive as long as some manager uses it */
+    delete mgr1;
+    QCOMPARE(mgr2->timeout(), quint32(1234));
+    QCOMPARE(mgr2->accountCount(), 1);
+    delete mgr2;
+
+    mgr1 = new Manager(Manager::ShareBackend);
+    QVERIFY(mgr1->timeout() != quint32(1234));
+    delete mgr1;
+
+    delete quiet;
+    delete typed;
+    delete other;
+}
+
+void AccountsTest::testLazyInitialization()
+{
+    clearDb();
+
+    Manager *mgr = new Manager(EMAIL_SERVICE_TYPE,
+                               Manager::LazyInitialization);
+    QVERIFY(mgr->options().testFlag(Manager::LazyInitialization));
+    QVERIFY(!mgr->options().testFlag(Manager::DisableNotifications));
+    QCOMPARE(mgr->serviceType(), EMAIL_SERVICE_TYPE);
+
+    /* The first query initializes the manager */
+    QCOMPARE(mgr->accountList(), AccountIdList());
+    QCOMPARE(mgr->lastError().type(), Error::NoError);
+    QCOMPARE(mgr->serviceType(), EMAIL_SERVICE_TYPE);
+    QVERIFY(mgr->options().testFlag(Manager::LazyInitialization));
+    delete mgr;
+
+    /* Connecting to a signal initializes the manager, too */
+    mgr = new Manager(Manager::LazyInitialization);
+    QSignalSpy created(mgr, SIGNAL(accountCreated(Accounts::AccountId)));
+    Account *account = mgr->createAccount(PROVIDER);
+    account->syncAndBlock();
+    QTRY_COMPARE(created.count(), 1);
+    delete account;
+    delete mgr;
+
+    /* A manager which is never used can be destroyed */
+    mgr = new Manager(Manager::LazyInitialization);
+    delete mgr;
+}
+
+void AccountsTest::testStatistics()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(!mgr->statisticsEnabled());
+
+    Account *account = mgr->createAccount(PROVIDER);
+    account->setValue("key", 1);
+    QVERIFY(account->syncAndBlock());
+    AccountId id = account->id();
+    delete account;
+    QCOMPARE(mgr->statistics().count(Statistics::WriteValue), quint64(0));
+
+    mgr->setStatisticsEnabled(true);
+    QVERIFY(mgr->statisticsEnabled());
+
+    QCOMPARE(mgr->accountList().count(), 1);
+    account = mgr->account(id);
+    QVERIFY(account != 0);
+    QCOMPARE(mgr->account(id), account);
+    QCOMPARE(account->value("key").toInt(), 1);
+    account->setValue("key", 2);
+    QSignalSpy synced(account, SIGNAL(synced()));
+    account->sync();
+    QTRY_COMPARE(synced.count(), 1);
+    QVERIFY(account->syncAndBlock());
+
+    Statistics statistics = mgr->statistics();
+    QCOMPARE(statistics.count(Statistics::ListAccounts), quint64(1));
+    QCOMPARE(statistics.count(Statistics::LoadAccount), quint64(1));
+    QCOMPARE(statistics.count(Statistics::CacheMiss), quint64(1));
+    QCOMPARE(statistics.count(Statistics::CacheHit), quint64(1));
+    QCOMPARE(statistics.count(Statistics::ReadValue), quint64(1));
+    QCOMPARE(statistics.count(Statistics::WriteValue), quint64(1));
+    QCOMPARE(statistics.count(Statistics::StoreAsync), quint64(1));
+    QCOMPARE(statistics.count(Statistics::StoreBlocking), quint64(1));
+    QCOMPARE(statistics.count(Statistics::LockWait), quint64(0));
+
+    /* The histogram accounts for every operation */
+    quint64 total = 0;
+    for (int i = 0; i < Statistics::bucketCount(); i++) {
+        total += statistics.histogram(Statistics::StoreAsync, i);
+    }
+    QCOMPARE(total, quint64(1));
+    QVERIFY(statistics.maxTime(Statistics::StoreAsync) <=
+            statistics.totalTime(Statistics::StoreAsync));
+    QCOMPARE(Statistics::bucketLimit(0), qint64(10));
+    QCOMPARE(Statistics::bucketLimit(2), qint64(1000));
+    QCOMPARE(Statistics::bucketLimit(Statistics::bucketCount() - 1), qint64(-1));
+
+    mgr->resetStatistics();
+    QCOMPARE(mgr->statistics().count(Statistics::ListAccounts), quint64(0));
+
+    /* So are the operations made through an AccountService */
+    AccountService *accountService =
+        new AccountService(account, mgr->service(MYSERVICE));
+    accountService->setValue("key", 3);
+    QCOMPARE(accountService->value("key").toInt(), 3);
+    statistics = mgr->statistics();
+    QCOMPARE(statistics.count(Statistics::ReadValue), quint64(1));
+    QCOMPARE(statistics.count(Statistics::WriteValue), quint64(1));
+    delete accountService;
+
+    delete mgr;
+}
+
 void AccountsTest::testCreateAccount()
 {
     clearDb();
@@ -239,6 +435,113 @@ void AccountsTest::testObjectsLifetime()
     delete ownedAccount;
 }
 
+void AccountsTest::testAccountsBatch()
+{
+    clearDb();
+
+    Manager *manager = new Manager();
+
+    Account *account = manager->createAccount(PROVIDER);
+    account->syncAndBlock();
+    AccountId firstId = account->id();
+    delete account;
+
+    account = manager->createAccount(PROVIDER);
+    account->syncAndBlock();
+    AccountId secondId = account->id();
+    delete account;
+
+    Account *shared = manager->account(firstId);
+    QVERIFY(shared != 0);
+    QCOMPARE(manager->lastError().type(), Error::NoError);
+
+    AccountId missingId = secondId + 100;
+    QHash<AccountId, Error> errors;
+    QList<Account *> accounts =
+        manager->accounts(AccountIdList() << firstId << missingId << secondId,
+                          &errors);
+    QCOMPARE(accounts.count(), 2);
+    QCOMPARE(accounts[0], shared);
+    QCOMPARE(accounts[1]->id(), secondId);
+    QCOMPARE(accounts[1], manager->account(secondId));
+
+    /* Failures are reported per account, not in lastError() */
+    QCOMPARE(errors.count(), 1);
+    QCOMPARE(errors.value(missingId).type(), Error::AccountNotFound);
+    QCOMPARE(manager->lastError().type(), Error::NoError);
+
+    delete manager;
+}
+
+void AccountsTest::testAccountCache()
+{
+    clearDb();
+
+    Manager *manager = new Manager();
+    QCOMPARE(manager->accountCacheLimit(), 0);
+
+    AccountIdList ids;
+    for (int i = 0; i < 3; i++) {
+        Account *account = manager->createAccount(PROVIDER);
+        account->syncAndBlock();
+        ids.append(account->id());
+        delete account;
+    }
+
+    QPointer<Account> first = manager->account(ids[0]);
+    QPointer<Account> second = manager->account(ids[1]);
+    Watch *watch = second->watchKey("key");
+    QVERIFY(watch != 0);
+    QPointer<Account> third = manager->account(ids[2]);
+
+    /* Lowering the limit evicts the least recently used account, but not
+     * the one being watched */
+    manager->setAccountCacheLimit(2);
+    QCOMPARE(manager->accountCacheLimit(), 2);
+    QTRY_VERIFY(first == 0);
+    QVERIFY(second != 0);
+    QVERIFY(third != 0);
+
+    /* Requesting the account again reloads it */
+    Account *reloaded = manager->account(ids[0]);
+    QVERIFY(reloaded != 0);
+    QCOMPARE(reloaded->id(), ids[0]);
+
+    /* Accounts with unsaved changes are kept, and so are all the accounts
+     * returned by a single call, even if they exceed the limit */
+    QPointer<Account> modified = reloaded;
+    modified->setValue("key", QString("value"));
+    QList<Account *> accounts = manager->accounts(ids);
+    QCOMPARE(accounts.count(), 3);
+    QList<QPointer<Account> > returned;
+    Q_FOREACH (Account *account, accounts) returned.append(account);
+    QTest::qWait(100);
+    Q_FOREACH (const QPointer<Account> &account, returned) {
+        QVERIFY(account != 0);
+    }
+    QVERIFY(modified != 0);
+    modified->discardChanges();
+
+    /* So are the accounts having callbacks installed with addWatch() */
+    quint32 watchId = modified->addWatch("key", [](const QStringList &) {});
+    QVERIFY(manager->account(ids[2]) != 0);
+    QTest::qWait(100);
+    QVERIFY(modified != 0);
+    modified->removeWatch(watchId);
+
+    /* Removed accounts are dropped from the cache */
+    QSignalSpy accountRemoved(manager,
+                              SIGNAL(accountRemoved(Accounts::AccountId)));
+    QPointer<Account> removed = manager->account(ids[2]);
+    removed->remove();
+    removed->syncAndBlock();
+    QTRY_COMPARE(accountRemoved.count(), 1);
+    QTRY_VERIFY(removed == 0);
+    QVERIFY(manager->account(ids[2]) == 0);
+
+    delete manager;
+}
+
 void AccountsTest::testAccountList()
 {
     clearDb();
@@ -257,7 +560,122 @@ void AccountsTest::testAccountList()
     list = mgr->accountList("e-mail");
     QVERIFY(list.isEmpty());
 
+    QCOMPARE(mgr->accountCount(), 1);
+    QCOMPARE(mgr->accountCount("e-mail"), 0);
+    QCOMPARE(mgr->enabledAccountCount(), mgr->accountListEnabled().count());
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testForEachAccount()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    AccountIdList ids;
+    for (int i = 0; i < 3; i++) {
+        Account *account = mgr->createAccount(PROVIDER);
+        account->setDisplayName(QString("account %1").arg(i));
+        account->setEnabled(i != 1);
+        account->syncAndBlock();
+        ids.append(account->id());
+        delete account;
+    }
+
+    /* A shared account is reused */
+    Account *shared = mgr->account(ids[0]);
+
+    AccountIdList visited;
+    QStringList names;
+    Account *visitedShared = 0;
+    int count = mgr->forEachAccount(QString(), [&](Account *account) {
+        visited.append(account->id());
+        names.append(account->displayName());
+        if (account->id() == ids[0]) visitedShared = account;
+        return true;
+    });
+    QCOMPARE(count, 3);
+    QCOMPARE(visited.toSet(), ids.toSet());
+    QVERIFY(names.contains("account 2"));
+    QCOMPARE(visitedShared, shared);
+
+    visited.clear();
+    count = mgr->forEachEnabledAccount(QString(), [&](Account *account) {
+        visited.append(account->id());
+        return true;
+    });
+    QCOMPARE(count, 2);
+    QVERIFY(!visited.contains(ids[1]));
+
+    /* Stop the iteration early */
+    count = mgr->forEachAccount(QString(), [](Account *) { return false; });
+    QCOMPARE(count, 1);
+
+    count = mgr->forEachAccount("e-mail", [](Account *) { return true; });
+    QCOMPARE(count, 0);
+
+    delete mgr;
+}
+
+void AccountsTest::testAccountData()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount("MyProvider");
+    account->setDisplayName("Data account");
+    account->setEnabled(true);
+    account->setValue("username", QString("john"));
+    account->selectService(service);
+    account->setEnabled(true);
+    account->setValue("parameters/port", 993);
+    QVERIFY(account->syncAndBlock());
+    AccountId id = account->id();
     delete account;
+
+    QHash<AccountId, Error> errors;
+    AccountIdList ids;
+    ids << id << 1234;
+    AccountDataList list = mgr->accountData(ids, &errors);
+    QCOMPARE(list.count(), 1);
+    QCOMPARE(errors.count(), 1);
+    QCOMPARE(errors.value(1234).type(), Error::AccountNotFound);
+
+    AccountData data = list.first();
+    QVERIFY(data.isValid());
+    QCOMPARE(data.id(), id);
+    QCOMPARE(data.providerName(), QString("MyProvider"));
+    QCOMPARE(data.displayName(), QString("Data account"));
+    QVERIFY(data.isEnabled());
+    QCOMPARE(data.enabledServices(), QStringList() << MYSERVICE);
+    QCOMPARE(data.value("username").toString(), QString("john"));
+    QCOMPARE(data.values().value("username").toString(), QString("john"));
+    /* Service settings are not included */
+    QVERIFY(!data.values().contains("parameters/port"));
+    QCOMPARE(data.value("unset", 5).toInt(), 5);
+
+    /* An account already loaded is reused, and its state is not altered */
+    account = mgr->account(id);
+    account->selectService(service);
+    list = mgr->accountData(AccountIdList() << id);
+    QCOMPARE(list.count(), 1);
+    QCOMPARE(list.first().displayName(), QString("Data account"));
+    QCOMPARE(list.first().value("username").toString(), QString("john"));
+    QCOMPARE(account->selectedService(), service);
+
+    /* Copies share the data */
+    AccountData copy = data;
+    QCOMPARE(copy.id(), id);
+    QVERIFY(!AccountData().isValid());
+
     delete mgr;
 }
 
@@ -356,6 +774,66 @@ void AccountsTest::testServiceList()
     delete mgr;
 }
 
+void AccountsTest::testServiceCatalog()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    /* Repeated queries return the same objects */
+    ServiceList list = mgr->serviceList();
+    QCOMPARE(list.count(), 2);
+    ServiceList again = mgr->serviceList();
+    QCOMPARE(again, list);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+    QVERIFY(mgr->serviceList("e-mail").contains(service));
+    QVERIFY(!mgr->service(SERVICE).isValid());
+    QVERIFY(!mgr->service(SERVICE).isValid());
+
+    list = mgr->serviceListByTag("email");
+    QCOMPARE(list.count(), 1);
+    QCOMPARE(list.first().name(), MYSERVICE);
+    QVERIFY(mgr->serviceListByTag("unexisting-tag").isEmpty());
+
+    QCOMPARE(mgr->provider("MyProvider").name(), QString("MyProvider"));
+    QVERIFY(!mgr->provider("unexisting-provider").isValid());
+    QCOMPARE(mgr->providerList().count(), 1);
+
+    Application application = mgr->application("Mailer");
+    QCOMPARE(mgr->serviceList(application).count(), 1);
+    QCOMPARE(mgr->serviceList(application).count(), 1);
+    QCOMPARE(mgr->applicationList(service).count(), 1);
+    QCOMPARE(mgr->applicationList(service).count(), 1);
+
+    delete mgr;
+
+    /* A manager for a service type still finds services of other types */
+    mgr = new Manager("e-mail");
+    QCOMPARE(mgr->serviceList().count(), 1);
+    QCOMPARE(mgr->serviceList("sharing").count(), 1);
+    QVERIFY(mgr->service(OTHERSERVICE).isValid());
+    delete mgr;
+
+    /* Installing or removing a service file invalidates the catalog */
+    mgr = new Manager();
+    QCOMPARE(mgr->serviceList().count(), 2);
+    QFile file(QStringLiteral(DATA_PATH "/CatalogService.service"));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    file.write("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n"
+               "<service id=\"CatalogService\">\n"
+               "  <type>sharing</type>\n"
+               "  <name>Catalog Service</name>\n"
+               "</service>\n");
+    file.close();
+    QTRY_COMPARE(mgr->serviceList().count(), 3);
+    QVERIFY(mgr->service(QStringLiteral("CatalogService")).isValid());
+
+    QVERIFY(file.remove());
+    QTRY_COMPARE(mgr->serviceList().count(), 2);
+    delete mgr;
+}
+
 void AccountsTest::testServiceConst()
 {
     Manager *mgr = new Manager();
@@ -518,57 +996,505 @@ void AccountsTest::testAccountValue()
     account->value(QString("test"), val);
     QCOMPARE(val.toString(), QString("value"));
 
-    SettingSource source;
-    source = account->value(QString("test"), val);
-    QCOMPARE(val.toString(), QString("value"));
+    SettingSource source;
+    source = account->value(QString("test"), val);
+    QCOMPARE(val.toString(), QString("value"));
+
+    QVariant intval = QVariant::Int;
+    account->value("testint", intval);
+    qDebug("Val: %d", intval.toInt());
+    QVERIFY(intval.toInt() == int_value);
+
+    QVERIFY(source == ACCOUNT);
+
+    QCOMPARE(account->value("names").toStringList(), names);
+    QCOMPARE(account->value("big distance").toULongLong(), quint64(3));
+    QCOMPARE(account->value("big difference").toLongLong(), qint64(-300));
+
+    /* test the convenience methods */
+    QString strval = account->valueAsString("test");
+    QCOMPARE (strval, QString("value"));
+    QCOMPARE(account->valueAsString("test", "Hi", &source), QString("value"));
+    QCOMPARE(source, ACCOUNT);
+
+    QCOMPARE(account->valueAsBool("boolean"), false);
+    QCOMPARE(account->valueAsBool("boolean", true, &source), false);
+    QCOMPARE(source, ACCOUNT);
+
+    QCOMPARE(account->valueAsUInt64("big distance"), quint64(3));
+    QCOMPARE(account->valueAsUInt64("big distance", 10, &source), quint64(3));
+    QCOMPARE(source, ACCOUNT);
+
+    strval = account->valueAsString("test_unexisting", "hello");
+    QCOMPARE (strval, QString("hello"));
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testAccountValues()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
+
+    QVariantMap values;
+    values.insert("name", QString("John"));
+    values.insert("age", 42);
+    values.insert("nicknames", QStringList() << "J" << "Johnny");
+    account->beginGroup("person");
+    account->setValues(values);
+    account->endGroup();
+    QVERIFY(account->syncAndBlock());
+
+    QCOMPARE(account->value("person/age").toInt(), 42);
+
+    account->beginGroup("person");
+    QVariantMap read = account->values(QStringList() <<
+                                       "name" << "age" << "nicknames" <<
+                                       "unset");
+    account->endGroup();
+    QCOMPARE(read.count(), 3);
+    QCOMPARE(read.value("name").toString(), QString("John"));
+    QCOMPARE(read.value("age").toInt(), 42);
+    QCOMPARE(read.value("nicknames").toStringList(),
+             QStringList() << "J" << "Johnny");
+    QVERIFY(!read.contains("unset"));
+
+    QCOMPARE(account->values(QStringList()), QVariantMap());
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testSettingKey()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    QVERIFY(SettingKey().isEmpty());
+    const SettingKey server("server");
+    const SettingKey port(QString("port"));
+    QCOMPARE(server.toString(), QString("server"));
+    QCOMPARE(port.toLatin1(), QByteArray("port"));
+
+    Account *account = mgr->createAccount(NULL);
+    QVERIFY(account != 0);
+
+    /* The key is relative to the current group */
+    account->beginGroup("parameters");
+    account->setValue(server, QString("example.com"));
+    account->setValue(port, 143);
+    QCOMPARE(account->value(server).toString(), QString("example.com"));
+    account->endGroup();
+    QCOMPARE(account->value("parameters/server").toString(),
+             QString("example.com"));
+    QCOMPARE(account->value(port, 10).toInt(), 10);
+
+    SettingSource source;
+    account->beginGroup("parameters");
+    QCOMPARE(account->value(port, QVariant(), &source).toInt(), 143);
+    QCOMPARE(source, ACCOUNT);
+    account->remove(port);
+    QVERIFY(!account->value(port).isValid());
+    account->endGroup();
+
+    /* A long key doesn't fit in the stack buffer */
+    const SettingKey longKey(QString(300, QChar('k')));
+    account->beginGroup("group");
+    account->setValue(longKey, true);
+    QCOMPARE(account->value(longKey).toBool(), true);
+    account->endGroup();
+    QVERIFY(account->syncAndBlock());
+
+    account->beginGroup("parameters");
+    Watch *watch = account->watchKey(server);
+    QVERIFY(watch != 0);
+    QSignalSpy notified(watch, SIGNAL(notify(const char *)));
+    account->setValue(server, QString("example.org"));
+    QVERIFY(account->syncAndBlock());
+    QCOMPARE(notified.count(), 1);
+    account->endGroup();
+
+    AccountService *accountService = new AccountService(account, service);
+    accountService->beginGroup("parameters");
+    QCOMPARE(accountService->value(server, &source).toString(),
+             QString("talk.google.com"));
+    QCOMPARE(source, TEMPLATE);
+    accountService->setValue(server, QString("example.net"));
+    QCOMPARE(accountService->value(server).toString(),
+             QString("example.net"));
+    accountService->remove(server);
+    QVERIFY(accountService->value(server, QVariant()).toString() !=
+            QString("example.net"));
+
+    delete accountService;
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testTypedValues()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount(NULL);
+    QVERIFY(account != 0);
+
+    account->setValue("int", -5);
+    account->setValue("uint", 7u);
+    account->setValue("int64", qint64(-300));
+    account->setValue("uint64", quint64(3));
+    account->setValue("bool", true);
+    account->setValue("string", QString("hello"));
+    account->setValue("number string", QString("42"));
+    account->setValue("list", QStringList() << "a" << "b");
+
+    SettingSource source = NONE;
+    QCOMPARE(account->value<int>("int", 0, &source), -5);
+    QCOMPARE(source, ACCOUNT);
+    QCOMPARE(account->value<uint>("uint"), 7u);
+    QCOMPARE(account->value<qint64>("int64"), qint64(-300));
+    QCOMPARE(account->value<quint64>("uint64"), quint64(3));
+    QCOMPARE(account->value<bool>("bool"), true);
+    QCOMPARE(account->value<QString>("string"), QString("hello"));
+    QCOMPARE(account->value<QStringList>("list"),
+             QStringList() << "a" << "b");
+    QCOMPARE(account->value<int>(SettingKey("uint64")), 3);
+
+    /* Conversions between types are still possible */
+    QCOMPARE(account->value<int>("number string"), 42);
+    QCOMPARE(account->value<QString>("int"), QString("-5"));
+
+    /* Unset keys */
+    QCOMPARE(account->value<int>("unset", 10, &source), 10);
+    QCOMPARE(source, NONE);
+    QCOMPARE(account->value<QString>("unset"), QString());
+
+    /* The untyped methods are still picked by default */
+    QCOMPARE(account->value("int", 3), QVariant(-5));
+    QCOMPARE(account->valueAsInt("int", 3), -5);
+    QCOMPARE(account->valueAsBool("unset", true), true);
+
+    QVERIFY(account->syncAndBlock());
+
+    AccountService *accountService = new AccountService(account, service);
+    accountService->beginGroup("parameters");
+    QCOMPARE(accountService->value<QString>("server", QString(), &source),
+             QString("talk.google.com"));
+    QCOMPARE(source, TEMPLATE);
+    QCOMPARE(accountService->value<int>(SettingKey("port")), 5223);
+    QCOMPARE(accountService->value<bool>("old-ssl"), true);
+    QCOMPARE(accountService->value<int>("unset", -1), -1);
+
+    delete accountService;
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testAccountSync()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
+
+    QString provider = account->providerName();
+    QCOMPARE(provider, PROVIDER);
+
+    QSignalSpy synced(account, SIGNAL(synced()));
+
+    account->sync();
+    QTRY_COMPARE(synced.count(), 1);
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testSyncAccounts()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    QList<Account *> accounts;
+    for (int i = 0; i < 5; i++) {
+        Account *account = mgr->createAccount(PROVIDER);
+        account->setDisplayName(QString("Account %1").arg(i));
+        accounts.append(account);
+    }
+
+    QSignalSpy batchSynced(mgr,
+        SIGNAL(accountsSynced(quint32, Accounts::Error)));
+    QSignalSpy accountSynced(accounts.first(), SIGNAL(synced()));
+
+    quint32 batchId = mgr->syncAccounts(accounts);
+    QVERIFY(batchId != 0);
+    /* The completion is always reported asynchronously */
+    QCOMPARE(batchSynced.count(), 0);
+    QTRY_COMPARE(batchSynced.count(), 1);
+    QCOMPARE(batchSynced.at(0).at(0).toUInt(), batchId);
+    Error error = batchSynced.at(0).at(1).value<Accounts::Error>();
+    QCOMPARE(error.type(), Error::NoError);
+    QCOMPARE(accountSynced.count(), 1);
+
+    QCOMPARE(mgr->accountList().count(), 5);
+    Q_FOREACH (Account *account, accounts) {
+        QVERIFY(account->id() != 0);
+    }
+
+    /* An empty batch completes, too */
+    batchSynced.clear();
+    quint32 emptyBatchId = mgr->syncAccounts(QList<Account *>());
+    QVERIFY(emptyBatchId != batchId);
+    QTRY_COMPARE(batchSynced.count(), 1);
+    QCOMPARE(batchSynced.at(0).at(0).toUInt(), emptyBatchId);
+
+    qDeleteAll(accounts);
+    delete mgr;
+}
+
+void AccountsTest::testSyncCoalescing()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+    QCOMPARE(mgr->syncCoalescing(), false);
+    mgr->setSyncCoalescing(true);
+    QCOMPARE(mgr->syncCoalescing(), true);
+
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
+
+    QSignalSpy synced(account, SIGNAL(synced()));
+    QSignalSpy error(account, SIGNAL(error(Accounts::Error)));
+
+    /* Calls made while a store is in progress are merged */
+    for (int i = 0; i < 3; i++) {
+        account->setValue("counter", i);
+        account->sync();
+    }
+    QTRY_COMPARE(synced.count(), 1);
+    QTest::qWait(100);
+    QCOMPARE(synced.count(), 1);
+    QCOMPARE(error.count(), 0);
+
+    AccountId id = account->id();
+    QVERIFY(id != 0);
+
+    /* All the changes have been written */
+    Manager *mgr2 = new Manager();
+    Account *copy = mgr2->account(id);
+    QVERIFY(copy != 0);
+    QCOMPARE(copy->value("counter").toInt(), 2);
+    delete mgr2;
+
+    /* Once the store is complete, sync() starts a new one */
+    account->setValue("counter", 3);
+    account->sync();
+    QTRY_COMPARE(synced.count(), 2);
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testSyncTimeout()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+    mgr->setTimeout(123);
+
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
+    account->setDisplayName("Timeout");
+
+    Error error(Error::Unknown);
+    QVERIFY(account->syncAndBlock(0, &error));
+    QCOMPARE(error.type(), Error::NoError);
+    QVERIFY(account->id() != 0);
+
+    /* The manager timeout is restored */
+    QCOMPARE(mgr->timeout(), quint32(123));
+
+    account->setDisplayName("Timeout again");
+    QVERIFY(account->syncAndBlock(500));
+    QCOMPARE(mgr->timeout(), quint32(123));
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testStoreRetry()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+    mgr->setTimeout(20);
+    mgr->setRetryPolicy(RetryPolicy(20, 100, 1000, 0.5));
+
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
+    account->setDisplayName("Locked");
+    QVERIFY(account->syncAndBlock());
+
+    QSignalSpy synced(account, SIGNAL(synced()));
+    QSignalSpy error(account, SIGNAL(error(Accounts::Error)));
+
+    /* Another connection holds a write transaction */
+    QByteArray dbPath = QDir(QString(getenv("ACCOUNTS"))).
+        filePath(QStringLiteral("accounts.db")).toUtf8();
+    sqlite3 *db = 0;
+    QCOMPARE(sqlite3_open(dbPath.constData(), &db), SQLITE_OK);
+    QCOMPARE(sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0), SQLITE_OK);
 
-    QVariant intval = QVariant::Int;
-    account->value("testint", intval);
-    qDebug("Val: %d", intval.toInt());
-    QVERIFY(intval.toInt() == int_value);
+    /* The store is retried until the DB is unlocked */
+    account->setValue("key", 1);
+    account->sync();
+    QTest::qWait(300);
+    QCOMPARE(synced.count(), 0);
+    QCOMPARE(error.count(), 0);
 
-    QVERIFY(source == ACCOUNT);
+    QCOMPARE(sqlite3_exec(db, "ROLLBACK", 0, 0, 0), SQLITE_OK);
+    QTRY_COMPARE(synced.count(), 1);
+    QCOMPARE(error.count(), 0);
+
+    /* After the deadline, the error is reported */
+    synced.clear();
+    QCOMPARE(sqlite3_exec(db, "BEGIN IMMEDIATE", 0, 0, 0), SQLITE_OK);
+    QElapsedTimer timer;
+    timer.start();
+    account->setValue("key", 2);
+    account->sync();
+    QTRY_COMPARE_WITH_TIMEOUT(error.count(), 1, 5000);
+    QVERIFY(timer.elapsed() >= 800);
+    Error err = error.at(0).at(0).value<Accounts::Error>();
+    QCOMPARE(err.type(), Error::DatabaseLocked);
+    QCOMPARE(synced.count(), 0);
 
-    QCOMPARE(account->value("names").toStringList(), names);
-    QCOMPARE(account->value("big distance").toULongLong(), quint64(3));
-    QCOMPARE(account->value("big difference").toLongLong(), qint64(-300));
+    QCOMPARE(sqlite3_exec(db, "ROLLBACK", 0, 0, 0), SQLITE_OK);
+    sqlite3_close(db);
 
-    /* test the convenience methods */
-    QString strval = account->valueAsString("test");
-    QCOMPARE (strval, QString("value"));
-    QCOMPARE(account->valueAsString("test", "Hi", &source), QString("value"));
-    QCOMPARE(source, ACCOUNT);
+    delete account;
+    delete mgr;
+}
 
-    QCOMPARE(account->valueAsBool("boolean"), false);
-    QCOMPARE(account->valueAsBool("boolean", true, &source), false);
-    QCOMPARE(source, ACCOUNT);
+void AccountsTest::testCancelSync()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
 
-    QCOMPARE(account->valueAsUInt64("big distance"), quint64(3));
-    QCOMPARE(account->valueAsUInt64("big distance", 10, &source), quint64(3));
-    QCOMPARE(source, ACCOUNT);
+    Account *account = mgr->createAccount(PROVIDER);
+    QVERIFY(account != 0);
 
-    strval = account->valueAsString("test_unexisting", "hello");
-    QCOMPARE (strval, QString("hello"));
+    QSignalSpy synced(account, SIGNAL(synced()));
+    QSignalSpy error(account, SIGNAL(error(Accounts::Error)));
+
+    /* Nothing to cancel */
+    account->cancelSync();
+    QCOMPARE(error.count(), 0);
+
+    account->sync();
+    account->cancelSync();
+    QCOMPARE(error.count(), 1);
+    Error err = error.at(0).at(0).value<Accounts::Error>();
+    QCOMPARE(err.type(), Error::Cancelled);
+    QTest::qWait(100);
+    QCOMPARE(synced.count(), 0);
+    QCOMPARE(error.count(), 1);
+
+    /* The account can still be stored */
+    account->sync();
+    QTRY_COMPARE(synced.count(), 1);
+    QCOMPARE(error.count(), 1);
 
     delete account;
     delete mgr;
 }
 
-void AccountsTest::testAccountSync()
+void AccountsTest::testPendingChanges()
 {
+    clearDb();
+
     Manager *mgr = new Manager();
     QVERIFY(mgr != 0);
 
-    Account *account = mgr->createAccount(PROVIDER);
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount("MyProvider");
     QVERIFY(account != 0);
+    /* A new account must be stored */
+    QVERIFY(account->hasPendingChanges());
+
+    account->setDisplayName("Original");
+    account->setValue("username", QString("john"));
+    QVERIFY(account->syncAndBlock());
+    QVERIFY(!account->hasPendingChanges());
+    QVERIFY(account->pendingChanges().isEmpty());
+
+    account->setValue("username", QString("jack"));
+    account->setValue("username", QString("jim"));
+    account->setDisplayName("Changed");
+    account->selectService(service);
+    account->setEnabled(true);
+    account->setValue("parameters/port", 993);
+    QVERIFY(account->hasPendingChanges());
+
+    QMap<QString, QStringList> changes = account->pendingChanges();
+    QCOMPARE(changes.count(), 2);
+    QCOMPARE(changes.value(QString()),
+             QStringList() << "name" << "username");
+    QCOMPARE(changes.value(MYSERVICE),
+             QStringList() << "enabled" << "parameters/port");
+
+    /* Discarding restores the original values */
+    account->discardChanges();
+    QVERIFY(!account->hasPendingChanges());
+    QCOMPARE(account->selectedService(), service);
+    QCOMPARE(account->isEnabled(), false);
+    QCOMPARE(account->value("parameters/port").toInt(), 5223);
+    account->selectService();
+    QCOMPARE(account->value("username").toString(), QString("john"));
+    QCOMPARE(account->displayName(), QString("Original"));
 
-    QString provider = account->providerName();
-    QCOMPARE(provider, PROVIDER);
+    /* Changes made through an AccountService are tracked too */
+    AccountService *accountService = new AccountService(account, service);
+    accountService->setValue("parameters/server", QString("example.com"));
+    QCOMPARE(account->pendingChanges().value(MYSERVICE),
+             QStringList() << "parameters/server");
+    delete accountService;
 
-    QSignalSpy synced(account, SIGNAL(synced()));
+    QVERIFY(account->syncAndBlock());
+    QVERIFY(!account->hasPendingChanges());
 
+    /* The changes are only forgotten once they have been stored */
+    QSignalSpy synced(account, SIGNAL(synced()));
+    account->setValue("username", QString("joe"));
     account->sync();
+    account->cancelSync();
+    QCOMPARE(account->pendingChanges().value(QString()),
+             QStringList() << "username");
+    account->sync();
+    QVERIFY(account->hasPendingChanges());
     QTRY_COMPARE(synced.count(), 1);
+    QVERIFY(!account->hasPendingChanges());
+
+    account->remove();
+    QVERIFY(account->hasPendingChanges());
+    QVERIFY(account->pendingChanges().isEmpty());
+    QVERIFY(account->syncAndBlock());
 
     delete account;
     delete mgr;
@@ -837,6 +1763,211 @@ void AccountsTest::testWatches()
     delete mgr;
 }
 
+void AccountsTest::testWatchCallbacks()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount(NULL);
+    QVERIFY(account != 0);
+    account->selectService(service);
+
+    QList<QStringList> serverChanges;
+    quint32 serverId = account->addWatch("parameters/server",
+                                         [&](const QStringList &keys) {
+        serverChanges.append(keys);
+    });
+    QVERIFY(serverId != 0);
+
+    QList<QStringList> groupChanges;
+    account->addWatch("parameters/", [&](const QStringList &keys) {
+        groupChanges.append(keys);
+    });
+
+    QList<QStringList> allChanges;
+    account->addWatch(QString(), [&](const QStringList &keys) {
+        allChanges.append(keys);
+    });
+
+    /* Watches on the global settings are not affected */
+    account->selectService();
+    int globalChanges = 0;
+    account->addWatch(QString(), [&](const QStringList &) {
+        globalChanges++;
+    });
+    account->selectService(service);
+    QCOMPARE(account->selectedService(), service);
+
+    account->setValue("parameters/server", QString("xxx.example.com"));
+    account->setValue("parameters/port", 45);
+    account->setValue("username", QString("john"));
+    account->sync();
+
+    QCOMPARE(serverChanges.count(), 1);
+    QCOMPARE(serverChanges.at(0), QStringList() << "parameters/server");
+    QCOMPARE(groupChanges.count(), 1);
+    QCOMPARE(groupChanges.at(0).toSet(),
+             (QStringList() << "parameters/server" <<
+              "parameters/port").toSet());
+    QCOMPARE(allChanges.count(), 1);
+    QVERIFY(allChanges.at(0).contains("username"));
+    QCOMPARE(globalChanges, 0);
+
+    /* Removed watches are not invoked */
+    account->removeWatch(serverId);
+    serverChanges.clear();
+    groupChanges.clear();
+    account->setValue("parameters/server", QString("yyy.example.com"));
+    account->sync();
+    QCOMPARE(serverChanges.count(), 0);
+    QCOMPARE(groupChanges.count(), 1);
+
+    /* A watch can remove itself */
+    quint32 onceId = 0;
+    int onceCount = 0;
+    onceId = account->addWatch("username", [&](const QStringList &) {
+        onceCount++;
+        account->removeWatch(onceId);
+    });
+    account->setValue("username", QString("jack"));
+    account->sync();
+    account->setValue("username", QString("jim"));
+    account->sync();
+    QCOMPARE(onceCount, 1);
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testWatchBatching()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount(NULL);
+    QVERIFY(account != 0);
+    account->selectService(service);
+
+    account->beginGroup("parameters");
+    Watch *immediate = account->watchKey();
+    QSignalSpy immediateChanged(immediate,
+                                SIGNAL(changed(const QVariantMap &)));
+    Watch *batched = account->watchKey(QString(), 100);
+    QSignalSpy batchedNotify(batched, SIGNAL(notify(const char *)));
+    QSignalSpy batchedChanged(batched, SIGNAL(changed(const QVariantMap &)));
+    account->endGroup();
+
+    account->setValue("parameters/server", QString("xxx.example.com"));
+    account->setValue("parameters/port", 45);
+    account->sync();
+    account->setValue("parameters/port", 46);
+    account->setValue("username", QString("john"));
+    account->sync();
+
+    /* Unbatched watches deliver each store operation */
+    QCOMPARE(immediateChanged.count(), 2);
+    QVariantMap values = immediateChanged.at(0).at(0).toMap();
+    QCOMPARE(values.count(), 2);
+    QCOMPARE(values.value("parameters/server").toString(),
+             QString("xxx.example.com"));
+    QCOMPARE(values.value("parameters/port").toInt(), 45);
+
+    /* The batched watch delivers the latest values at once */
+    QCOMPARE(batchedChanged.count(), 0);
+    QTRY_COMPARE(batchedChanged.count(), 1);
+    QCOMPARE(batchedNotify.count(), 1);
+    values = batchedChanged.at(0).at(0).toMap();
+    QCOMPARE(values.count(), 2);
+    QCOMPARE(values.value("parameters/server").toString(),
+             QString("xxx.example.com"));
+    QCOMPARE(values.value("parameters/port").toInt(), 46);
+
+    /* The selected service is not altered */
+    QCOMPARE(account->selectedService(), service);
+
+    /* The slots of notify() can delete the watch */
+    QPointer<Watch> deleted = account->watchKey("parameters/port");
+    QSignalSpy deletedChanged(deleted.data(),
+                              SIGNAL(changed(const QVariantMap &)));
+    QObject::connect(deleted.data(), &Watch::notify,
+                     deleted.data(), [&deleted]() { delete deleted.data(); });
+    account->setValue("parameters/port", 47);
+    account->sync();
+    QTRY_VERIFY(deleted.isNull());
+    QCOMPARE(deletedChanged.count(), 0);
+
+    delete account;
+    delete mgr;
+}
+
+void AccountsTest::testManagerWatchKey()
+{
+    clearDb();
+
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    /* An existing account */
+    Account *account = mgr->createAccount("MyProvider");
+    account->selectService(service);
+    account->setValue("token", QString("first"));
+    QVERIFY(account->syncAndBlock());
+
+    QVERIFY(!mgr->watchKey("unexisting-service", "token"));
+    QVERIFY(mgr->watchKey(MYSERVICE, "token"));
+
+    QSignalSpy keyChanged(mgr,
+        SIGNAL(keyChanged(Accounts::AccountId, const QString &,
+                          const QString &, const QVariant &)));
+
+    account->setValue("token", QString("second"));
+    QVERIFY(account->syncAndBlock());
+    QTRY_VERIFY(keyChanged.count() >= 1);
+    QList<QVariant> args = keyChanged.last();
+    QCOMPARE(args.at(0).toUInt(), account->id());
+    QCOMPARE(args.at(1).toString(), MYSERVICE);
+    QCOMPARE(args.at(2).toString(), QString("token"));
+    QCOMPARE(args.at(3).toString(), QString("second"));
+
+    /* Changes to other keys carry the current value of the watched key */
+    keyChanged.clear();
+    account->setValue("other", 3);
+    QVERIFY(account->syncAndBlock());
+    QTRY_VERIFY(keyChanged.count() >= 1);
+    QCOMPARE(keyChanged.last().at(3).toString(), QString("second"));
+
+    /* Accounts created later are watched too */
+    keyChanged.clear();
+    Manager *mgr2 = new Manager();
+    Account *account2 = mgr2->createAccount("MyProvider");
+    account2->selectService(mgr2->service(MYSERVICE));
+    account2->setValue("token", QString("other account"));
+    QVERIFY(account2->syncAndBlock());
+    QTRY_VERIFY(keyChanged.count() >= 1);
+    QCOMPARE(keyChanged.last().at(0).toUInt(), account2->id());
+    QCOMPARE(keyChanged.last().at(3).toString(), QString("other account"));
+
+    /* No notifications after unwatching */
+    keyChanged.clear();
+    mgr->unwatchKey(MYSERVICE, "token");
+    account->setValue("token", QString("third"));
+    QVERIFY(account->syncAndBlock());
+    QTest::qWait(100);
+    QCOMPARE(keyChanged.count(), 0);
+
+    delete mgr2;
+    delete mgr;
+}
+
 void AccountsTest::testServiceData()
 {
     Manager *mgr = new Manager();
@@ -990,6 +2121,65 @@ void AccountsTest::testSettings()
     delete mgr;
 }
 
+void AccountsTest::testSettingsIndex()
+{
+    Manager *mgr = new Manager();
+    QVERIFY(mgr != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+
+    Account *account = mgr->createAccount(NULL);
+    QVERIFY(account != 0);
+
+    account->setValue("username", QString("fool"));
+    QCOMPARE(account->childKeys(), QStringList() << "username");
+    QVERIFY(account->contains("username"));
+    QVERIFY(account->childGroups().isEmpty());
+
+    /* The index must follow the changes */
+    account->setValue("parameters/server", QString("example.com"));
+    QCOMPARE(account->childGroups(), QStringList() << "parameters");
+    account->beginGroup("parameters");
+    QVERIFY(account->contains("server"));
+    QVERIFY(!account->contains("username"));
+    account->endGroup();
+    QVERIFY(!account->contains("parameters/server"));
+
+    account->remove("username");
+    QVERIFY(!account->contains("username"));
+    QVERIFY(account->syncAndBlock());
+
+    /* Each service has its own keys */
+    account->selectService(service);
+    QVERIFY(!account->contains("username"));
+    /* Building the index does not change the selected service */
+    QCOMPARE(account->selectedService(), service);
+    QVERIFY(account->childGroups().contains("parameters"));
+    account->beginGroup("parameters");
+    QVERIFY(account->contains("server")); /* from the template */
+    QVERIFY(!account->contains("nickname"));
+    account->endGroup();
+
+    /* Changes made through an AccountService are seen by the account */
+    AccountService *accountService = new AccountService(account, service);
+    QVERIFY(!accountService->contains("nickname"));
+    accountService->setValue("nickname", QString("Fool"));
+    QVERIFY(accountService->contains("nickname"));
+    QVERIFY(account->contains("nickname"));
+    account->remove("nickname");
+    QVERIFY(!accountService->contains("nickname"));
+    QVERIFY(!account->contains("nickname"));
+
+    account->selectService();
+    QCOMPARE(account->childGroups(), QStringList() << "parameters");
+    QCOMPARE(account->selectedService(), Service());
+
+    delete accountService;
+    delete account;
+    delete mgr;
+}
+
 void AccountsTest::testKeySignVerify()
 {
 #ifndef HAVE_AEGISCRYPTO
@@ -1104,6 +2294,13 @@ void AccountsTest::testCredentialsId()
     QCOMPARE(account->credentialsId(), globalId);
     QCOMPARE(account->selectedService(), service);
 
+    /* the global ID is found outside of the current group, which is
+     * preserved */
+    account->beginGroup("parameters");
+    QCOMPARE(account->credentialsId(), globalId);
+    QCOMPARE(account->group(), QString("parameters"));
+    account->endGroup();
+
     /* now make sure that we can get the ID from the global accounts settings */
     account->selectService();
     QCOMPARE(account->credentialsId(), globalId);
@@ -1111,6 +2308,66 @@ void AccountsTest::testCredentialsId()
     delete mgr;
 }
 
+void AccountsTest::testValueWithFallback()
+{
+    Manager *mgr = new Manager;
+    QVERIFY(mgr != 0);
+
+    Account *account = mgr->createAccount("MyProvider");
+    QVERIFY(account != 0);
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+    Service otherService = mgr->service(OTHERSERVICE);
+    QVERIFY(otherService.isValid());
+
+    account->setValue("parameters/server", QString("global.example.com"));
+    account->setValue("username", QString("john"));
+    account->selectService(service);
+    account->setValue("username", QString("jack"));
+    QVERIFY(account->syncAndBlock());
+
+    account->selectService(otherService);
+    SettingSource source;
+
+    /* The service value wins */
+    QCOMPARE(account->valueWithFallback("username", service, QVariant(),
+                                        &source).toString(),
+             QString("jack"));
+    QCOMPARE(source, ACCOUNT);
+
+    /* The global account value wins over the service template */
+    account->beginGroup("parameters");
+    QCOMPARE(account->valueWithFallback("server", service, QVariant(),
+                                        &source).toString(),
+             QString("global.example.com"));
+    QCOMPARE(source, ACCOUNT);
+
+    /* Then comes the template */
+    QCOMPARE(account->valueWithFallback("port", service, QVariant(),
+                                        &source).toInt(), 5223);
+    QCOMPARE(source, TEMPLATE);
+
+    QCOMPARE(account->valueWithFallback("unset", service, 7,
+                                        &source).toInt(), 7);
+    QCOMPARE(source, NONE);
+
+    /* Neither the selected service nor the group are changed */
+    QCOMPARE(account->selectedService(), otherService);
+    QCOMPARE(account->group(), QString("parameters"));
+    account->endGroup();
+
+    /* By default, the selected service is used */
+    account->selectService(service);
+    QCOMPARE(account->valueWithFallback("username").toString(),
+             QString("jack"));
+    account->selectService();
+    QCOMPARE(account->valueWithFallback("username").toString(),
+             QString("john"));
+
+    delete mgr;
+}
+
 void AccountsTest::testAuthData()
 {
     Manager *manager = new Manager;
@@ -1245,6 +2502,18 @@ void AccountsTest::testListEnabledServices()
 
     list = account->enabledServices();
     QVERIFY(list.isEmpty());
+    QVERIFY(account->enabledServices().isEmpty());
+
+    /* Changes made by other processes are also seen */
+    Manager *mgr2 = new Manager();
+    Account *remote = mgr2->account(account->id());
+    QVERIFY(remote != 0);
+    remote->selectService(mgr2->service(MYSERVICE));
+    remote->setEnabled(true);
+    QVERIFY(remote->syncAndBlock());
+    QTRY_COMPARE(account->enabledServices().count(), 1);
+    QCOMPARE(account->enabledServices().first().name(), MYSERVICE);
+    delete mgr2;
 
     delete account;
     delete mgr;
@@ -1275,6 +2544,8 @@ void AccountsTest::testListEnabledByServiceType()
 
     list = mgr->accountListEnabled();
     QCOMPARE(list.count(), 1);
+    QCOMPARE(mgr->enabledAccountCount("e-mail"), 1);
+    QCOMPARE(mgr->enabledAccountCount(), 1);
 
     account->setEnabled(false);
     account->sync();
@@ -1398,6 +2669,61 @@ void AccountsTest::testUpdateAccount()
     delete mgr2;
 }
 
+void AccountsTest::testCoalescedEvents()
+{
+    clearDb();
+
+    Manager *mgr = new Manager("e-mail");
+    QVERIFY(mgr != 0);
+    QCOMPARE(mgr->coalescingInterval(), -1);
+    mgr->setCoalescingInterval(100);
+    QCOMPARE(mgr->coalescingInterval(), 100);
+
+    QSignalSpy accountUpdated(mgr,
+                              SIGNAL(accountUpdated(Accounts::AccountId)));
+    QSignalSpy accountsUpdated(mgr,
+        SIGNAL(accountsUpdated(const Accounts::AccountIdList &)));
+    QSignalSpy enabledEvents(mgr,
+        SIGNAL(enabledEvents(const Accounts::AccountIdList &)));
+
+    Account *account = mgr->createAccount("MyProvider");
+    QVERIFY(account != 0);
+    account->syncAndBlock();
+
+    Service service = mgr->service(MYSERVICE);
+    QVERIFY(service.isValid());
+    account->selectService(service);
+
+    /* Several updates in a row are delivered in one batch */
+    for (int i = 0; i < 5; i++) {
+        account->setValue("key", i);
+        account->syncAndBlock();
+    }
+    account->setEnabled(true);
+    account->syncAndBlock();
+    account->setEnabled(false);
+    account->syncAndBlock();
+
+    QTRY_COMPARE(accountsUpdated.count(), 1);
+    QCOMPARE(accountsUpdated.at(0).at(0).value<AccountIdList>(),
+             AccountIdList() << account->id());
+    QTRY_COMPARE(enabledEvents.count(), 1);
+    QCOMPARE(enabledEvents.at(0).at(0).value<AccountIdList>(),
+             AccountIdList() << account->id());
+    QCOMPARE(accountUpdated.count(), 0);
+
+    /* Disabling coalescing restores the per-account signal */
+    mgr->setCoalescingInterval(-1);
+    accountsUpdated.clear();
+    account->setValue("key", QString("last"));
+    account->syncAndBlock();
+    QTRY_COMPARE(accountUpdated.count(), 1);
+    QCOMPARE(accountsUpdated.count(), 0);
+
+    delete account;
+    delete mgr;
+}
+
 void AccountsTest::testApplication()
 {
     Manager *manager = new Manager();
@@ -1463,5 +2789,65 @@ void AccountsTest::testApplicationListServices()
     delete manager;
 }
 
+void AccountsTest::testAsyncManager()
+{
+    clearDb();
+
+    Manager *manager = new Manager();
+    Account *account = manager->createAccount("MyProvider");
+    account->setValue("username", QString("john"));
+    account->syncAndBlock();
+    AccountId accountId = account->id();
+    delete account;
+
+    AsyncManager *asyncManager = new AsyncManager();
+
+    QFuture<AccountIdList> list = asyncManager->accountList();
+    QCOMPARE(list.result(), AccountIdList() << accountId);
+
+    QFuture<QVariantMap> settings = asyncManager->accountSettings(accountId);
+    QCOMPARE(settings.result().value("username").toString(), QString("john"));
+
+    QVariantMap changes;
+    changes.insert("username", QString("jack"));
+    changes.insert("parameters/port", 25);
+    QFuture<bool> stored =
+        asyncManager->storeSettings(accountId, MYSERVICE, changes);
+    QVERIFY(stored.result());
+
+    settings = asyncManager->accountSettings(accountId, MYSERVICE);
+    QCOMPARE(settings.result().value("username").toString(), QString("jack"));
+    QCOMPARE(settings.result().value("parameters/port").toInt(), 25);
+
+    QFuture<QString> provider =
+        asyncManager->run<QString>([accountId](Manager *m) {
+            Account *account = m->account(accountId);
+            return account ? account->providerName() : QString();
+        });
+    QCOMPARE(provider.result(), QString("MyProvider"));
+
+    /* Loading a non existing account */
+    settings = asyncManager->accountSettings(accountId + 1);
+    QVERIFY(settings.result().isEmpty());
+
+    /* Unknown services are not mistaken for the global settings */
+    settings = asyncManager->accountSettings(accountId, "no-such-service");
+    QVERIFY(settings.result().isEmpty());
+    stored = asyncManager->storeSettings(accountId, "no-such-service",
+                                         changes);
+    QVERIFY(!stored.result());
+
+    delete asyncManager;
+
+    /* The changes are visible from the main thread too */
+    account = Account::fromId(manager, accountId);
+    QVERIFY(account != 0);
+    account->selectService(manager->service(MYSERVICE));
+    QCOMPARE(account->value("parameters/port").toInt(), 25);
+    delete account;
+
+    delete manager;
+}
+
 QTEST_GUILESS_MAIN(AccountsTest)
 #include "tst_libaccounts.moc"
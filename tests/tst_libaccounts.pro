@@ -11,6 +11,9 @@ QT = \
 
 LIBS += -laccounts-qt5
 
+CONFIG += link_pkgconfig
+PKGCONFIG += sqlite3
+
 INCLUDEPATH += $${TOP_SRC_DIR}
 QMAKE_LIBDIR += \
     $${TOP_BUILD_DIR}/Accounts